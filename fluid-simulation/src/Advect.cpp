@@ -1,263 +1,791 @@
 #include "Advect.h"
 
-// 3D semi-lagrangian advection, going backward in time to get new values
+#include <array>
+#include <limits>
+
+// Flag the cells of the active tiles within reach of the band: a backtrace
+// moves by at most _dt times the largest velocity component along each
+// axis, and its interpolation reads one cell further. The bound holds as
+// long as _maxVelocity covers every face the backtraces read: the LIQUID
+// and EXTRAPOLATED faces it is measured on, the faces past the
+// extrapolation band, zeroed by Fluids::extrapolate, and the SOLID ones,
+// which stay at zero. The band cells are the ones not clamped, like the
+// liquid just added by the sources, and the clamped ones next to a cell of
+// the other sign along i, j or k. They are bounded by a box in each tile, a
+// cell is flagged if it lies within reach of the box of its tile or of an
+// active neighbor, the inactive ones having no band cells. The other cells
+// only read clamped values of their own sign, their advection would give
+// back their value
+bool Advect::narrowBand(const SparseField<Real, std::uint16_t>& F)
+{
+    if (_maxVelocity < 0.0 || _dt * _maxVelocity >= F.tileWidth() - 1)
+    {
+        return false;
+    }
+    const std::int32_t reach =
+        static_cast<std::int32_t>(std::ceil(_dt * _maxVelocity)) + 1;
+    const auto& tiles = F.activeTiles();
+    const std::int64_t nbTiles = tiles.size();
+
+    // Box of the band cells of each tile grown by the reach, by block
+    constexpr std::int32_t none = std::numeric_limits<std::int32_t>::max();
+    std::vector<std::array<std::int32_t, 6>> boxes(nbTiles);
+    #pragma omp parallel for
+    for (std::int64_t t = 0; t < nbTiles; ++t)
+    {
+        auto& box = boxes[F.tileBlock(tiles[t])];
+        box = {none, none, none, -none, -none, -none};
+        F.forEachCell(tiles[t], [&](const std::int32_t i,
+                    const std::int32_t j, const std::int32_t k,
+                    const std::uint64_t n)
+        {
+            const bool inside = F(n) < 0.0;
+            if (std::abs(F(n)) != F.background()
+                    || (F.neighbor<1, 0, 0>(n, i, j, k) < 0.0) != inside
+                    || (F.neighbor<0, 1, 0>(n, i, j, k) < 0.0) != inside
+                    || (F.z() > 1
+                        && (F.neighbor<0, 0, 1>(n, i, j, k) < 0.0) != inside))
+            {
+                box = {std::min(box[0], i), std::min(box[1], j),
+                    std::min(box[2], k), std::max(box[3], i),
+                    std::max(box[4], j), std::max(box[5], k)};
+            }
+        });
+        if (box[0] != none)
+        {
+            box = {box[0]-reach, box[1]-reach, box[2]-reach,
+                box[3]+reach, box[4]+reach, box[5]+reach};
+        }
+    }
+
+    _band.assign(F.storage(), 0);
+    #pragma omp parallel for
+    for (std::int64_t t = 0; t < nbTiles; ++t)
+    {
+        std::array<std::array<std::int32_t, 6>, 27> near;
+        std::uint32_t nbNear = 0;
+        F.forEachNeighborTile(tiles[t], [&](const std::uint32_t block)
+        {
+            if (boxes[block][0] != none)
+            {
+                near[nbNear++] = boxes[block];
+            }
+        });
+        if (nbNear == 0)
+        {
+            continue;
+        }
+        F.forEachCell(tiles[t], [&](const std::int32_t i,
+                    const std::int32_t j, const std::int32_t k,
+                    const std::uint64_t n)
+        {
+            for (std::uint32_t q = 0; q < nbNear; ++q)
+            {
+                const auto& box = near[q];
+                if (i >= box[0] && j >= box[1] && k >= box[2]
+                        && i <= box[3] && j <= box[4] && k <= box[5])
+                {
+                    _band[n] = 1;
+                    return;
+                }
+            }
+        });
+    }
+    return true;
+}
+
+// 3D semi-lagrangian advection, going backward in time to get new values.
+// The advected values are written in Fprev, which is then swapped with F,
+// so Fprev ends up holding the previous values without copying the field.
+// The MacCormack corrections are swapped in the same way from corrected(b)
 void Advect3D::advect(
-        const StaggeredGrid<double, std::uint16_t>& grid,
-        Field<double, std::uint16_t>& F,
-        Field<double, std::uint16_t>& Fprev,
+        const StaggeredGrid<Real, std::uint16_t>& grid,
+        Field<Real, std::uint16_t>& F,
+        Field<Real, std::uint16_t>& Fprev,
         const std::uint8_t b
     )
+{
+    #pragma omp parallel
+    {
+        Row row(F.x());
+        #pragma omp for collapse(2)
+        for (std::uint16_t k = 0; k < F.z(); ++k)
+        {
+            for (std::uint16_t j = 0; j < F.y(); ++j)
+            {
+                for (std::uint16_t i = 0; i < F.x(); ++i)
+                {
+                    // The solid samples are kept, whatever their position
+                    if (F.label(i, j, k) & SOLID)
+                    {
+                        backtrace(row, i, grid, F, b, i, j, k, 0.0, 0.0, 0.0);
+                    }
+                    else
+                    {
+                        backtrace(row, i, grid, F, b, i, j, k,
+                                grid.getU(i, j, k, b), grid.getV(i, j, k, b),
+                                grid.getW(i, j, k, b));
+                    }
+                }
+                interpolateRow(F, F.x(), row);
+                for (std::uint16_t i = 0; i < F.x(); ++i)
+                {
+                    Fprev(i, j, k) = F.label(i, j, k) & SOLID
+                        ? F(i, j, k) : row.values[i];
+                }
+            }
+        }
+    }
+    Fprev.copyHalo(F);
+    F.swap(Fprev);
+
+    if (Config::advection == MACCORMACK)
+    {
+        // The faces on the far side of the grid are not corrected
+        const std::uint16_t X = grid._surface.x();
+        const std::uint16_t Y = grid._surface.y();
+        const std::uint16_t Z = grid._surface.z();
+        auto& C = corrected(b, F);
+        #pragma omp parallel for collapse(2)
+        for (std::uint16_t k = 0; k < F.z(); ++k)
+        {
+            for (std::uint16_t j = 0; j < F.y(); ++j)
+            {
+                for (std::uint16_t i = 0; i < F.x(); ++i)
+                {
+                    const bool inside = i < X && j < Y && k < Z;
+                    C(i, j, k) = !inside || F.label(i, j, k) & SOLID
+                        ? F(i, j, k)
+                        : correct(grid, F, Fprev, i, j, k, b);
+                }
+            }
+        }
+        C.copyHalo(F);
+        F.swap(C);
+    }
+}
+
+// 3D semi-lagrangian advection of the U, V and W faces in a single pass over
+// the grid, so the three components are backtraced with the velocity of the
+// previous step and share the sums of faces of their velocity (see
+// forEachFace). The MacCormack correction reads the advected faces and the
+// previous ones around each face, so it writes in separate fields, swapped
+// with the advected ones afterwards
+void Advect3D::advectVelocity(StaggeredGrid<Real, std::uint16_t>& grid)
+{
+    Field<Real, std::uint16_t>* F[] = {&grid._U, &grid._V, &grid._W};
+    Field<Real, std::uint16_t>* Fprev[] =
+        {&grid._UPrev, &grid._VPrev, &grid._WPrev};
+
+    forEachFace(grid, [&](const std::uint8_t b, const std::int32_t j,
+                const std::int32_t k, const std::int32_t n, Row& row)
+    {
+        const auto& G = *F[b-1];
+        auto& Gprev = *Fprev[b-1];
+        for (std::int32_t i = 0; i < n; ++i)
+        {
+            backtrace(row, i, grid, G, b, i, j, k, row.u[i], row.v[i],
+                    row.w[i]);
+        }
+        interpolateRow(G, n, row);
+        for (std::int32_t i = 0; i < n; ++i)
+        {
+            Gprev(i, j, k) = G.label(i, j, k) & SOLID
+                ? G(i, j, k) : row.values[i];
+        }
+    });
+    for (std::uint8_t c = 0; c < 3; ++c)
+    {
+        Fprev[c]->copyHalo(*F[c]);
+        F[c]->swap(*Fprev[c]);
+    }
+
+    if (Config::advection == MACCORMACK)
+    {
+        // The faces on the far side of the grid are not corrected
+        const std::int32_t X = grid._surface.x();
+        const std::int32_t Y = grid._surface.y();
+        const std::int32_t Z = grid._surface.z();
+        for (std::uint8_t c = 0; c < 3; ++c)
+        {
+            corrected(c+1, *F[c]);
+        }
+        forEachFace(grid, [&](const std::uint8_t b, const std::int32_t j,
+                    const std::int32_t k, const std::int32_t n, Row& row)
+        {
+            const auto& G = *F[b-1];
+            const auto& Gprev = *Fprev[b-1];
+            auto& C = *_corrected[b];
+            for (std::int32_t i = 0; i < n; ++i)
+            {
+                const bool inside = i < X && j < Y && k < Z;
+                C(i, j, k) = !inside || G.label(i, j, k) & SOLID
+                    ? G(i, j, k)
+                    : correct(grid, G, Gprev, b, i, j, k, row.u[i],
+                            row.v[i], row.w[i]);
+            }
+        });
+        for (std::uint8_t c = 0; c < 3; ++c)
+        {
+            auto& C = corrected(c+1, *F[c]);
+            C.copyHalo(*F[c]);
+            F[c]->swap(C);
+        }
+    }
+}
+
+// Call f(b, j, k, n, row) on every row of n U, V or W faces (b = 1, 2 or 3)
+// with the velocity of its faces in row.u, row.v and row.w, the rows being
+// spread over the threads. The velocity is averaged as in getU, getV and
+// getW, but each sum of two faces of a row is computed once for the faces
+// of the row and for the other components: the sums V(j)+V(j+1) and
+// W(k)+W(k+1) give the V and W velocities of the U faces and halves of the
+// V velocity of the W faces and of the W velocity of the V faces, and the
+// sums U(j-1)+U(j) and U(k-1)+U(k) the U velocities of the V and W faces
+template<typename Function>
+void Advect3D::forEachFace(
+        const StaggeredGrid<Real, std::uint16_t>& grid,
+        Function f
+    ) const
+{
+    const auto& U = grid._U;
+    const auto& V = grid._V;
+    const auto& W = grid._W;
+    const std::int32_t X = grid._surface.x();
+    const std::int32_t Y = grid._surface.y();
+    const std::int32_t Z = grid._surface.z();
+
+    #pragma omp parallel
+    {
+        // Sums of the row, shifted by one for the halo at i = -1
+        std::vector<double> sumV(X+2);
+        std::vector<double> sumW(X+2);
+        std::vector<double> sumU(X+1);
+        Row row(X+1);
+
+        #pragma omp for collapse(2)
+        for (std::int32_t k = 0; k <= Z; ++k)
+        {
+            for (std::int32_t j = 0; j <= Y; ++j)
+            {
+                if (j < Y)
+                {
+                    for (std::int32_t i = -1; i <= X; ++i)
+                    {
+                        sumV[i+1] = V(i, j, k) + V(i, j+1, k);
+                    }
+                }
+                if (k < Z)
+                {
+                    for (std::int32_t i = -1; i <= X; ++i)
+                    {
+                        sumW[i+1] = W(i, j, k) + W(i, j, k+1);
+                    }
+                }
+                if (j < Y && k < Z)
+                {
+                    for (std::int32_t i = 0; i <= X; ++i)
+                    {
+                        row.u[i] = U(i, j, k);
+                        row.v[i] = 0.25*(sumV[i] + sumV[i+1]);
+                        row.w[i] = 0.25*(sumW[i] + sumW[i+1]);
+                    }
+                    f(1, j, k, X+1, row);
+                }
+                if (k < Z)
+                {
+                    for (std::int32_t i = 0; i <= X; ++i)
+                    {
+                        sumU[i] = U(i, j, k) + U(i, j-1, k);
+                    }
+                    for (std::int32_t i = 0; i < X; ++i)
+                    {
+                        row.u[i] = 0.25*(sumU[i] + sumU[i+1]);
+                        row.v[i] = V(i, j, k);
+                        row.w[i] = 0.25*(sumW[i+1]
+                                + W(i, j-1, k) + W(i, j-1, k+1));
+                    }
+                    f(2, j, k, X, row);
+                }
+                if (j < Y)
+                {
+                    for (std::int32_t i = 0; i <= X; ++i)
+                    {
+                        sumU[i] = U(i, j, k) + U(i, j, k-1);
+                    }
+                    for (std::int32_t i = 0; i < X; ++i)
+                    {
+                        row.u[i] = 0.25*(sumU[i] + sumU[i+1]);
+                        row.v[i] = 0.25*(sumV[i+1]
+                                + V(i, j, k-1) + V(i, j+1, k-1));
+                        row.w[i] = W(i, j, k);
+                    }
+                    f(3, j, k, X, row);
+                }
+            }
+        }
+    }
+}
+
+// 3D semi-lagrangian advection of the level set, the inactive tiles are
+// far enough from the interface to keep their background value, and so
+// are the cells left out by narrowBand when Config::narrowBandAdvection
+void Advect3D::advect(
+        const StaggeredGrid<Real, std::uint16_t>& grid,
+        SparseField<Real, std::uint16_t>& F,
+        SparseField<Real, std::uint16_t>& Fprev
+    )
 {
     Fprev = F;
-    const double dt = Config::dt * Config::N;
-    #pragma omp parallel for
-    for (std::uint64_t n = 0; n < grid._surface.maxIt(); ++n)
+    const auto& tiles = F.activeTiles();
+    const std::int64_t nbTiles = tiles.size();
+    const bool narrow = Config::narrowBandAdvection && narrowBand(F);
+    std::uint64_t cells = 0;
+    #pragma omp parallel
     {
-        const std::uint64_t xy =
-            static_cast<std::uint64_t>(grid._surface.x()*grid._surface.y());
-        const std::uint64_t m = n % xy;
-        const std::uint16_t i = m % grid._surface.x();
-        const std::uint16_t j = m / grid._surface.x();
-        const std::uint16_t k = n / xy;
-        if (!(F.label(i, j, k) & SOLID))
+        Row row(F.tileSize());
+        #pragma omp for reduction(+:cells)
+        for (std::int64_t t = 0; t < nbTiles; ++t)
         {
-            const double x =
-                std::clamp((static_cast<double>(i)-dt*grid.getU(i, j, k, b)),
-                            0.0,
-                            static_cast<double>(F.x()));
-            const double y =
-                std::clamp((static_cast<double>(j)-dt*grid.getV(i, j, k, b)),
-                            0.0,
-                            static_cast<double>(F.y()));
-            const double z =
-                std::clamp((static_cast<double>(k)-dt*grid.getW(i, j, k, b)),
-                            0.0,
-                            static_cast<double>(F.z()));
-            F(i, j, k) = interp(Fprev, x, y, z);
+            std::uint32_t p = 0;
+            F.forEachCell(tiles[t], [&](const std::uint16_t i,
+                        const std::uint16_t j, const std::uint16_t k,
+                        const std::uint64_t n)
+            {
+                if (narrow && !_band[n])
+                {
+                    return;
+                }
+                backtrace(row, p, grid, Fprev, 0, i, j, k,
+                        grid.getU(i, j, k, 0), grid.getV(i, j, k, 0),
+                        grid.getW(i, j, k, 0));
+                row.cells[p++] = n;
+            });
+            interpolateRow(Fprev, p, row);
+            for (std::uint32_t q = 0; q < p; ++q)
+            {
+                F(row.cells[q]) = row.values[q];
+            }
+            cells += p;
         }
     }
+    _levelSetCells = cells;
 
     if (Config::advection == MACCORMACK)
     {
-        // Reverse advection to calculate errors made,
-        // than correct the first advection to reduce the errors
+        // The corrections read the advected values around each cell, so
+        // they are written aside, then copied in F
+        auto& C = _correctedLevelSet;
+        C.resize(F.storage());
         #pragma omp parallel for
-        for (std::uint64_t n = 0; n < grid._surface.maxIt(); ++n)
+        for (std::int64_t t = 0; t < nbTiles; ++t)
         {
-            const std::uint64_t xy =
-                static_cast<std::uint64_t>(grid._surface.x()*grid._surface.y());
-            const std::uint64_t m = n % xy;
-            const std::uint16_t i = m % grid._surface.x();
-            const std::uint16_t j = m / grid._surface.x();
-            const std::uint16_t k = n / xy;
-            if (!(F.label(i, j, k) & SOLID))
+            F.forEachCell(tiles[t], [&](const std::uint16_t i,
+                        const std::uint16_t j, const std::uint16_t k,
+                        const std::uint64_t n)
             {
-                double x = std::clamp(
-                        (static_cast<double>(i)-dt*grid.getU(i, j, k, b)),
-                        0.0,
-                        static_cast<double>(F.x()));
-                double y = std::clamp(
-                        (static_cast<double>(j)-dt*grid.getV(i, j, k, b)),
-                        0.0,
-                        static_cast<double>(F.y()));
-                double z = std::clamp(
-                        (static_cast<double>(k)-dt*grid.getW(i, j, k, b)),
-                        0.0,
-                        static_cast<double>(F.z()));
-
-                std::uint16_t i0 =
-                    static_cast<std::uint16_t>(x);
-                std::uint16_t i1 =
-                    std::clamp(i0 + 1, 1, static_cast<int>(F.x()-1));
-                std::uint16_t j0 =
-                    static_cast<std::uint16_t>(y);
-                std::uint16_t j1 =
-                    std::clamp(j0 + 1, 1, static_cast<int>(F.y()-1));
-                std::uint16_t k0 =
-                    static_cast<std::uint16_t>(z);
-                std::uint16_t k1 =
-                    std::clamp(k0 + 1, 1, static_cast<int>(F.z()-1));
-
-                const double top = 
-                    std::max({F(i0, j0, k0), F(i0, j0, k1), F(i0, j1, k0),
-                            F(i0, j1, k1), F(i1, j0, k0), F(i1, j0, k1),
-                            F(i1, j1, k0), F(i1, j1, k1)});
-                const double bot =
-                    std::min({F(i0, j0, k0), F(i0, j0, k1), F(i0, j1, k0),
-                            F(i0, j1, k1), F(i1, j0, k0), F(i1, j0, k1),
-                            F(i1, j1, k0), F(i1, j1, k1)});
-
-                // Forward step after backward to get error
-                x = std::clamp(
-                        (static_cast<double>(i)+dt*grid.getU(i, j, k, b)),
-                        0.0,
-                        static_cast<double>(F.x()));
-                y = std::clamp(
-                        (static_cast<double>(j)+dt*grid.getV(i, j, k, b)),
-                        0.0,
-                        static_cast<double>(F.y()));
-                z = std::clamp(
-                        (static_cast<double>(k)+dt*grid.getW(i, j, k, b)),
-                        0.0,
-                        static_cast<double>(F.z()));
-
-                const double back = interp(F, x, y, z);
-                F(i, j, k) =
-                    std::clamp(
-                            F(i, j, k) + 0.5 * (Fprev(i, j, k) - back),
-                            bot,
-                            top
-                    );
-            }
+                if (!narrow || _band[n])
+                {
+                    C[n] = correct(grid, F, Fprev, i, j, k, 0);
+                }
+            });
+        }
+        #pragma omp parallel for
+        for (std::int64_t t = 0; t < nbTiles; ++t)
+        {
+            F.forEachCell(tiles[t], [&](const std::uint16_t,
+                        const std::uint16_t, const std::uint16_t,
+                        const std::uint64_t n)
+            {
+                if (!narrow || _band[n])
+                {
+                    F(n) = C[n];
+                }
+            });
         }
     }
 }
 
-// 3D interpolation in the field F
-inline double Advect3D::interp(
-        const Field<double, std::uint16_t>& F,
-        const double x,
-        const double y,
-        const double z
+// MacCormack correction of the advected value of the sample b of the
+// cell (i,j,k)
+template<typename Grid>
+inline double Advect3D::correct(
+        const StaggeredGrid<Real, std::uint16_t>& grid,
+        const Grid& F,
+        const Grid& Fprev,
+        const std::uint16_t i,
+        const std::uint16_t j,
+        const std::uint16_t k,
+        const std::uint8_t b
     ) const
 {
-    const std::uint16_t i0 = static_cast<std::uint16_t>(x);
-    const std::uint16_t i1 = std::clamp(i0 + 1, 1, static_cast<int>(F.x()-1));
-    const std::uint16_t j0 = static_cast<std::uint16_t>(y);
-    const std::uint16_t j1 = std::clamp(j0 + 1, 1, static_cast<int>(F.y()-1));
-    const std::uint16_t k0 = static_cast<std::uint16_t>(z);
-    const std::uint16_t k1 = std::clamp(k0 + 1, 1, static_cast<int>(F.z()-1));
-
-    const double s1 = x - i0;
-    const double s0 = 1.0 - s1;
-    const double t1 = y - j0;
-    const double t0 = 1.0 - t1;
-    const double u1 = z - k0;
-    const double u0 = 1.0 - u1;
-
-    return s0 * (     t0 * ( u0 * F(i0, j0, k0) + u1 * F(i0, j0, k1) )
-                    + t1 * ( u0 * F(i0, j1, k0) + u1 * F(i0, j1, k1) )
-                )
-         + s1 * (     t0 * ( u0 * F(i1, j0, k0) + u1 * F(i1, j0, k1) )
-                    + t1 * ( u0 * F(i1, j1, k0) + u1 * F(i1, j1, k1) )
-                );
+    return correct(grid, F, Fprev, b, i, j, k, grid.getU(i, j, k, b),
+            grid.getV(i, j, k, b), grid.getW(i, j, k, b));
+}
+
+// MacCormack correction of the advected value of the sample b at (i,j,k)
+// of velocity (u,v,w): reverse advection to calculate errors made,
+// than correct the first advection to reduce the errors
+template<typename Grid>
+inline double Advect3D::correct(
+        const StaggeredGrid<Real, std::uint16_t>& grid,
+        const Grid& F,
+        const Grid& Fprev,
+        const std::uint8_t b,
+        const std::int32_t i,
+        const std::int32_t j,
+        const std::int32_t k,
+        const double u,
+        const double v,
+        const double w
+    ) const
+{
+    double x, y, z;
+    trace(grid, F, b, i, j, k, u, v, w, _dt, x, y, z);
+
+    std::uint16_t i0 =
+        static_cast<std::uint16_t>(x);
+    std::uint16_t i1 =
+        std::clamp(i0 + 1, 1, static_cast<int>(F.x()-1));
+    std::uint16_t j0 =
+        static_cast<std::uint16_t>(y);
+    std::uint16_t j1 =
+        std::clamp(j0 + 1, 1, static_cast<int>(F.y()-1));
+    std::uint16_t k0 =
+        static_cast<std::uint16_t>(z);
+    std::uint16_t k1 =
+        std::clamp(k0 + 1, 1, static_cast<int>(F.z()-1));
+
+    const double top = 
+        std::max({Fprev(i0, j0, k0), Fprev(i0, j0, k1),
+                Fprev(i0, j1, k0), Fprev(i0, j1, k1),
+                Fprev(i1, j0, k0), Fprev(i1, j0, k1),
+                Fprev(i1, j1, k0), Fprev(i1, j1, k1)});
+    const double bot =
+        std::min({Fprev(i0, j0, k0), Fprev(i0, j0, k1),
+                Fprev(i0, j1, k0), Fprev(i0, j1, k1),
+                Fprev(i1, j0, k0), Fprev(i1, j0, k1),
+                Fprev(i1, j1, k0), Fprev(i1, j1, k1)});
+
+    // Forward step after backward to get error
+    trace(grid, F, b, i, j, k, u, v, w, -_dt, x, y, z);
+
+    const double back = interpolate(F, x, y, z);
+    return std::clamp(
+            F(i, j, k) + 0.5 * (Fprev(i, j, k) - back),
+            bot,
+            top
+        );
 }
 
 // 2D semi-lagrangian advection, going backward in time to get new values
 void Advect2D::advect(
-        const StaggeredGrid<double, std::uint16_t>& grid,
-        Field<double, std::uint16_t>& F,
-        Field<double, std::uint16_t>& Fprev,
+        const StaggeredGrid<Real, std::uint16_t>& grid,
+        Field<Real, std::uint16_t>& F,
+        Field<Real, std::uint16_t>& Fprev,
         const std::uint8_t b
     )
 {
-    Fprev = F;
-    const double dt = Config::dt * Config::N;
-    #pragma omp parallel for
-    for (std::uint64_t n = 0; n < grid._surface.maxIt(); ++n)
+    #pragma omp parallel
     {
-        const std::uint64_t xy =
-            static_cast<std::uint64_t>(grid._surface.x()*grid._surface.y());
-        const std::uint64_t m = n % xy;
-        const std::uint16_t i = m % grid._surface.x();
-        const std::uint16_t j = m / grid._surface.x();
-        if (!(F.label(i, j, 0) & SOLID))
+        Row row(F.x());
+        #pragma omp for
+        for (std::uint16_t j = 0; j < F.y(); ++j)
         {
-            const double x =
-                std::clamp((static_cast<double>(i)-dt*grid.getU(i, j, 0, b)),
-                            0.0,
-                            static_cast<double>(F.x()));
-            const double y =
-                std::clamp((static_cast<double>(j)-dt*grid.getV(i, j, 0, b)),
-                            0.0,
-                            static_cast<double>(F.y()));
-            F(i, j, 0) = interp(Fprev, x, y);
+            for (std::uint16_t i = 0; i < F.x(); ++i)
+            {
+                // The solid samples are kept, whatever their position
+                if (F.label(i, j, 0) & SOLID)
+                {
+                    backtrace(row, i, grid, F, b, i, j, 0, 0.0, 0.0, 0.0);
+                }
+                else
+                {
+                    backtrace(row, i, grid, F, b, i, j, 0,
+                            grid.getU(i, j, 0, b), grid.getV(i, j, 0, b), 0.0);
+                }
+            }
+            interpolateRow(F, F.x(), row);
+            for (std::uint16_t i = 0; i < F.x(); ++i)
+            {
+                Fprev(i, j, 0) = F.label(i, j, 0) & SOLID
+                    ? F(i, j, 0) : row.values[i];
+            }
         }
     }
+    Fprev.copyHalo(F);
+    F.swap(Fprev);
     if (Config::advection == MACCORMACK)
     {
-        // Reverse advection to calculate errors made,
-        // than correct the first advection to reduce the errors
+        // The faces on the far side of the grid are not corrected
+        const std::uint16_t X = grid._surface.x();
+        const std::uint16_t Y = grid._surface.y();
+        auto& C = corrected(b, F);
         #pragma omp parallel for
-        for (std::uint64_t n = 0; n < grid._surface.maxIt(); ++n)
+        for (std::uint16_t j = 0; j < F.y(); ++j)
+        {
+            for (std::uint16_t i = 0; i < F.x(); ++i)
+            {
+                const bool inside = i < X && j < Y;
+                C(i, j, 0) = !inside || F.label(i, j, 0) & SOLID
+                    ? F(i, j, 0)
+                    : correct(grid, F, Fprev, i, j, b);
+            }
+        }
+        C.copyHalo(F);
+        F.swap(C);
+    }
+}
+
+// 2D semi-lagrangian advection of the U and V faces in a single pass over
+// the grid, as in 3D
+void Advect2D::advectVelocity(StaggeredGrid<Real, std::uint16_t>& grid)
+{
+    Field<Real, std::uint16_t>* F[] = {&grid._U, &grid._V};
+    Field<Real, std::uint16_t>* Fprev[] = {&grid._UPrev, &grid._VPrev};
+
+    forEachFace(grid, [&](const std::uint8_t b, const std::int32_t j,
+                const std::int32_t n, Row& row)
+    {
+        const auto& G = *F[b-1];
+        auto& Gprev = *Fprev[b-1];
+        for (std::int32_t i = 0; i < n; ++i)
+        {
+            backtrace(row, i, grid, G, b, i, j, 0, row.u[i], row.v[i], 0.0);
+        }
+        interpolateRow(G, n, row);
+        for (std::int32_t i = 0; i < n; ++i)
+        {
+            Gprev(i, j, 0) = G.label(i, j, 0) & SOLID
+                ? G(i, j, 0) : row.values[i];
+        }
+    });
+    for (std::uint8_t c = 0; c < 2; ++c)
+    {
+        Fprev[c]->copyHalo(*F[c]);
+        F[c]->swap(*Fprev[c]);
+    }
+
+    if (Config::advection == MACCORMACK)
+    {
+        // The faces on the far side of the grid are not corrected
+        const std::int32_t X = grid._surface.x();
+        const std::int32_t Y = grid._surface.y();
+        for (std::uint8_t c = 0; c < 2; ++c)
+        {
+            corrected(c+1, *F[c]);
+        }
+        forEachFace(grid, [&](const std::uint8_t b, const std::int32_t j,
+                    const std::int32_t n, Row& row)
+        {
+            const auto& G = *F[b-1];
+            const auto& Gprev = *Fprev[b-1];
+            auto& C = *_corrected[b];
+            for (std::int32_t i = 0; i < n; ++i)
+            {
+                const bool inside = i < X && j < Y;
+                C(i, j, 0) = !inside || G.label(i, j, 0) & SOLID
+                    ? G(i, j, 0)
+                    : correct(grid, G, Gprev, b, i, j, row.u[i], row.v[i]);
+            }
+        });
+        for (std::uint8_t c = 0; c < 2; ++c)
+        {
+            auto& C = corrected(c+1, *F[c]);
+            C.copyHalo(*F[c]);
+            F[c]->swap(C);
+        }
+    }
+}
+
+// Call f(b, j, n, row) on every row of n U or V faces (b = 1 or 2) with
+// the velocity of its faces in row.u and row.v, as in 3D with the sums
+// V(j)+V(j+1) for the U faces and U(j-1)+U(j) for the V faces
+template<typename Function>
+void Advect2D::forEachFace(
+        const StaggeredGrid<Real, std::uint16_t>& grid,
+        Function f
+    ) const
+{
+    const auto& U = grid._U;
+    const auto& V = grid._V;
+    const std::int32_t X = grid._surface.x();
+    const std::int32_t Y = grid._surface.y();
+
+    #pragma omp parallel
+    {
+        // Sums of the row, shifted by one for the halo at i = -1
+        std::vector<double> sumV(X+2);
+        std::vector<double> sumU(X+1);
+        Row row(X+1);
+
+        #pragma omp for
+        for (std::int32_t j = 0; j <= Y; ++j)
+        {
+            if (j < Y)
+            {
+                for (std::int32_t i = -1; i <= X; ++i)
+                {
+                    sumV[i+1] = V(i, j, 0) + V(i, j+1, 0);
+                }
+                for (std::int32_t i = 0; i <= X; ++i)
+                {
+                    row.u[i] = U(i, j, 0);
+                    row.v[i] = 0.25*(sumV[i] + sumV[i+1]);
+                }
+                f(1, j, X+1, row);
+            }
+            for (std::int32_t i = 0; i <= X; ++i)
+            {
+                sumU[i] = U(i, j, 0) + U(i, j-1, 0);
+            }
+            for (std::int32_t i = 0; i < X; ++i)
+            {
+                row.u[i] = 0.25*(sumU[i] + sumU[i+1]);
+                row.v[i] = V(i, j, 0);
+            }
+            f(2, j, X, row);
+        }
+    }
+}
+
+// 2D semi-lagrangian advection of the level set, the inactive tiles are
+// far enough from the interface to keep their background value, and so
+// are the cells left out by narrowBand when Config::narrowBandAdvection
+void Advect2D::advect(
+        const StaggeredGrid<Real, std::uint16_t>& grid,
+        SparseField<Real, std::uint16_t>& F,
+        SparseField<Real, std::uint16_t>& Fprev
+    )
+{
+    Fprev = F;
+    const auto& tiles = F.activeTiles();
+    const std::int64_t nbTiles = tiles.size();
+    const bool narrow = Config::narrowBandAdvection && narrowBand(F);
+    std::uint64_t cells = 0;
+    #pragma omp parallel
+    {
+        Row row(F.tileSize());
+        #pragma omp for reduction(+:cells)
+        for (std::int64_t t = 0; t < nbTiles; ++t)
         {
-            const std::uint64_t xy =
-                static_cast<std::uint64_t>(grid._surface.x()*grid._surface.y());
-            const std::uint64_t m = n % xy;
-            const std::uint16_t i = m % grid._surface.x();
-            const std::uint16_t j = m / grid._surface.x();
-            if (!(F.label(i, j, 0) & SOLID))
+            std::uint32_t p = 0;
+            F.forEachCell(tiles[t], [&](const std::uint16_t i,
+                        const std::uint16_t j, const std::uint16_t,
+                        const std::uint64_t n)
             {
-                double x = std::clamp(
-                        (static_cast<double>(i)-dt*grid.getU(i, j, 0, b)),
-                        0.0,
-                        static_cast<double>(F.x()));
-                double y = std::clamp(
-                        (static_cast<double>(j)-dt*grid.getV(i, j, 0, b)),
-                        0.0,
-                        static_cast<double>(F.y()));
-
-                std::uint16_t i0 =
-                    static_cast<std::uint16_t>(x);
-                std::uint16_t i1 =
-                    std::clamp(i0 + 1, 1, static_cast<int>(F.x()-1));
-                std::uint16_t j0 =
-                    static_cast<std::uint16_t>(y);
-                std::uint16_t j1 =
-                    std::clamp(j0 + 1, 1, static_cast<int>(F.y()-1));
-
-                const double top = 
-                    std::max({F(i0, j0, 0), F(i0, j0, 0), F(i0, j1, 0),
-                            F(i0, j1, 0), F(i1, j0, 0), F(i1, j0, 0),
-                            F(i1, j1, 0), F(i1, j1, 0)});
-                const double bot =
-                    std::min({F(i0, j0, 0), F(i0, j0, 0), F(i0, j1, 0),
-                            F(i0, j1, 0), F(i1, j0, 0), F(i1, j0, 0),
-                            F(i1, j1, 0), F(i1, j1, 0)});
-
-                // Forward step after backward to get error
-                x = std::clamp(
-                        (static_cast<double>(i)+dt*grid.getU(i, j, 0, b)),
-                        0.0,
-                        static_cast<double>(F.x()));
-                y = std::clamp(
-                        (static_cast<double>(j)+dt*grid.getV(i, j, 0, b)),
-                        0.0,
-                        static_cast<double>(F.y()));
-
-                const double back = interp(F, x, y);
-                F(i, j, 0) =
-                    std::clamp(
-                            F(i, j, 0) + 0.5 * (Fprev(i, j, 0) - back),
-                            bot,
-                            top
-                    );
+                if (narrow && !_band[n])
+                {
+                    return;
+                }
+                backtrace(row, p, grid, Fprev, 0, i, j, 0,
+                        grid.getU(i, j, 0, 0), grid.getV(i, j, 0, 0), 0.0);
+                row.cells[p++] = n;
+            });
+            interpolateRow(Fprev, p, row);
+            for (std::uint32_t q = 0; q < p; ++q)
+            {
+                F(row.cells[q]) = row.values[q];
             }
+            cells += p;
+        }
+    }
+    _levelSetCells = cells;
+
+    if (Config::advection == MACCORMACK)
+    {
+        // The corrections read the advected values around each cell, so
+        // they are written aside, then copied in F
+        auto& C = _correctedLevelSet;
+        C.resize(F.storage());
+        #pragma omp parallel for
+        for (std::int64_t t = 0; t < nbTiles; ++t)
+        {
+            F.forEachCell(tiles[t], [&](const std::uint16_t i,
+                        const std::uint16_t j, const std::uint16_t,
+                        const std::uint64_t n)
+            {
+                if (!narrow || _band[n])
+                {
+                    C[n] = correct(grid, F, Fprev, i, j, 0);
+                }
+            });
+        }
+        #pragma omp parallel for
+        for (std::int64_t t = 0; t < nbTiles; ++t)
+        {
+            F.forEachCell(tiles[t], [&](const std::uint16_t,
+                        const std::uint16_t, const std::uint16_t,
+                        const std::uint64_t n)
+            {
+                if (!narrow || _band[n])
+                {
+                    F(n) = C[n];
+                }
+            });
         }
     }
 }
 
-// 2D interpolation in the field F
-inline double Advect2D::interp(
-        const Field<double, std::uint16_t>& F,
-        const double x,
-        const double y
+// MacCormack correction of the advected value of the sample b of the
+// cell (i,j)
+template<typename Grid>
+inline double Advect2D::correct(
+        const StaggeredGrid<Real, std::uint16_t>& grid,
+        const Grid& F,
+        const Grid& Fprev,
+        const std::uint16_t i,
+        const std::uint16_t j,
+        const std::uint8_t b
     ) const
 {
-    const std::uint16_t i0 = static_cast<std::uint16_t>(x);
-    const std::uint16_t i1 = i0 + 1;
-    const std::uint16_t j0 = static_cast<std::uint16_t>(y);
-    const std::uint16_t j1 = j0 + 1;
-
-    const double s1 = x - i0;
-    const double s0 = 1.0 - s1;
-    const double t1 = y - j0;
-    const double t0 = 1.0 - t1;
-
-    return s0 * (     t0 * F(i0, j0, 0)
-                    + t1 * F(i0, j1, 0)
-                )
-         + s1 * (     t0 * F(i1, j0, 0)
-                    + t1 * F(i1, j1, 0)
-                );
+    return correct(grid, F, Fprev, b, i, j, grid.getU(i, j, 0, b),
+            grid.getV(i, j, 0, b));
+}
+
+// MacCormack correction of the advected value of the sample b at (i,j)
+// of velocity (u,v): reverse advection to calculate errors made,
+// than correct the first advection to reduce the errors
+template<typename Grid>
+inline double Advect2D::correct(
+        const StaggeredGrid<Real, std::uint16_t>& grid,
+        const Grid& F,
+        const Grid& Fprev,
+        const std::uint8_t b,
+        const std::int32_t i,
+        const std::int32_t j,
+        const double u,
+        const double v
+    ) const
+{
+    double x, y, z;
+    trace(grid, F, b, i, j, 0, u, v, 0.0, _dt, x, y, z);
+
+    std::uint16_t i0 =
+        static_cast<std::uint16_t>(x);
+    std::uint16_t i1 =
+        std::clamp(i0 + 1, 1, static_cast<int>(F.x()-1));
+    std::uint16_t j0 =
+        static_cast<std::uint16_t>(y);
+    std::uint16_t j1 =
+        std::clamp(j0 + 1, 1, static_cast<int>(F.y()-1));
+
+    const double top = 
+        std::max({Fprev(i0, j0, 0), Fprev(i0, j0, 0), Fprev(i0, j1, 0),
+                Fprev(i0, j1, 0), Fprev(i1, j0, 0), Fprev(i1, j0, 0),
+                Fprev(i1, j1, 0), Fprev(i1, j1, 0)});
+    const double bot =
+        std::min({Fprev(i0, j0, 0), Fprev(i0, j0, 0), Fprev(i0, j1, 0),
+                Fprev(i0, j1, 0), Fprev(i1, j0, 0), Fprev(i1, j0, 0),
+                Fprev(i1, j1, 0), Fprev(i1, j1, 0)});
+
+    // Forward step after backward to get error
+    trace(grid, F, b, i, j, 0, u, v, 0.0, -_dt, x, y, z);
+
+    const double back = interpolate(F, x, y, 0.0);
+    return std::clamp(
+            F(i, j, 0) + 0.5 * (Fprev(i, j, 0) - back),
+            bot,
+            top
+        );
 }
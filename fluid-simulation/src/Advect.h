@@ -1,34 +1,259 @@
 #pragma once
 
+#include <array>
+#include <memory>
+#include <vector>
+
 #include "./types.h"
 #include "./config.h"
 #include "./StaggeredGrid.h"
+#include "./Interpolation.h"
 
 class Advect
 {
  public:
+    // Time step of the next advections, in seconds
+    void setTimeStep(const double dt)
+    {
+        _dt = dt * Config::N;
+    }
+    // Largest velocity component the next advections can read, which
+    // bounds how far a backtrace goes. Negative if unknown
+    void setMaxVelocity(const double umax)
+    {
+        _maxVelocity = umax;
+    }
+    // Number of cells of the level set advected by the last advection
+    std::uint64_t levelSetCells() const
+    {
+        return _levelSetCells;
+    }
     virtual void advect(
-            const StaggeredGrid<double, std::uint16_t>& grid,
-            Field<double, std::uint16_t>& F,
-            Field<double, std::uint16_t>& Fprev,
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            Field<Real, std::uint16_t>& F,
+            Field<Real, std::uint16_t>& Fprev,
             const std::uint8_t b
         ) = 0;
+    // Advect the level set on its active tiles, at the cell centers
+    virtual void advect(
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            SparseField<Real, std::uint16_t>& F,
+            SparseField<Real, std::uint16_t>& Fprev
+        ) = 0;
+    // Advect the U, V and W faces of the grid together
+    virtual void advectVelocity(StaggeredGrid<Real, std::uint16_t>& grid) = 0;
+
+ protected:
+    // Samples of a row of the grid (or of a tile of the level set), one
+    // per thread: their velocity, the position reached by going backward
+    // in time, the value interpolated there and their storage index
+    struct Row
+    {
+        explicit Row(const std::size_t size)
+            : u(size), v(size), w(size), x(size), y(size), z(size)
+            , values(size), cells(size) {}
+
+        std::vector<double> u;
+        std::vector<double> v;
+        std::vector<double> w;
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<double> z;
+        std::vector<double> values;
+        std::vector<std::uint64_t> cells;
+    };
+
+    // Velocity of the grid at the point (x,y,z), in the coordinates of the
+    // samples b (cell centers for 0, U, V or W faces for 1, 2 or 3)
+    inline void velocity(
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            const std::uint8_t b,
+            const double x,
+            const double y,
+            const double z,
+            double& u,
+            double& v,
+            double& w
+        ) const
+    {
+        // Position of the point in the coordinates of the faces c
+        const auto sample = [&](const Field<Real, std::uint16_t>& C,
+                const std::uint8_t c)
+        {
+            return interpolate(C,
+                    std::clamp(x + _offsets[b][0] - _offsets[c][0],
+                        0.0, C.x() - 1.0),
+                    std::clamp(y + _offsets[b][1] - _offsets[c][1],
+                        0.0, C.y() - 1.0),
+                    std::clamp(z + _offsets[b][2] - _offsets[c][2],
+                        0.0, C.z() - 1.0));
+        };
+        u = sample(grid._U, 1);
+        v = sample(grid._V, 2);
+        w = Config::dim == 3 ? sample(grid._W, 3) : 0.0;
+    }
+    // Position (x,y,z) reached by following the velocity backward in time
+    // by dt (forward if negative) from the sample b at (i,j,k) of velocity
+    // (u,v,w), with the integrator of Config::backtrace. It is clamped to
+    // the field F, whose size is the upper bound along each axis
+    template<typename Grid>
+    inline void trace(
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            const Grid& F,
+            const std::uint8_t b,
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k,
+            double u,
+            double v,
+            double w,
+            const double dt,
+            double& x,
+            double& y,
+            double& z
+        ) const
+    {
+        const double x0 = static_cast<double>(i);
+        const double y0 = static_cast<double>(j);
+        const double z0 = static_cast<double>(k);
+        if (Config::backtrace == RK2)
+        {
+            // Velocity at the midpoint
+            velocity(grid, b, x0-0.5*dt*u, y0-0.5*dt*v, z0-0.5*dt*w,
+                    u, v, w);
+        }
+        else if (Config::backtrace == RK3)
+        {
+            // Ralston's third order: 2/9, 3/9 and 4/9 of the velocities
+            // at the start, at half and at three quarters of the step
+            double u2, v2, w2, u3, v3, w3;
+            velocity(grid, b, x0-0.5*dt*u, y0-0.5*dt*v, z0-0.5*dt*w,
+                    u2, v2, w2);
+            velocity(grid, b, x0-0.75*dt*u2, y0-0.75*dt*v2, z0-0.75*dt*w2,
+                    u3, v3, w3);
+            u = (2.0*u + 3.0*u2 + 4.0*u3) / 9.0;
+            v = (2.0*v + 3.0*v2 + 4.0*v3) / 9.0;
+            w = (2.0*w + 3.0*w2 + 4.0*w3) / 9.0;
+        }
+        x = std::clamp(x0-dt*u, 0.0, static_cast<double>(F.x()));
+        y = std::clamp(y0-dt*v, 0.0, static_cast<double>(F.y()));
+        z = std::clamp(z0-dt*w, 0.0, static_cast<double>(F.z()));
+    }
+    // Position reached by going backward in time from the sample b at
+    // (i,j,k) of velocity (u,v,w), stored as the sample p of the row
+    template<typename Grid>
+    inline void backtrace(
+            Row& row,
+            const std::uint32_t p,
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            const Grid& F,
+            const std::uint8_t b,
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k,
+            const double u,
+            const double v,
+            const double w
+        ) const
+    {
+        trace(grid, F, b, i, j, k, u, v, w, _dt, row.x[p], row.y[p],
+                row.z[p]);
+    }
+    // Interpolate F at the n first positions of the row
+    template<typename Grid>
+    inline void interpolateRow(
+            const Grid& F,
+            const std::uint32_t n,
+            Row& row
+        ) const
+    {
+        interpolate(F, n, row.x.data(), row.y.data(), row.z.data(),
+                row.values.data());
+    }
+
+    // Flag in _band the cells of the active tiles of F close enough to the
+    // band (|F| < background) for a backtrace to reach it, the others keep
+    // their clamped value. False if the reach of a step is unknown or
+    // longer than a tile, every cell is advected then
+    bool narrowBand(const SparseField<Real, std::uint16_t>& F);
+
+    // Time step in cells per unit of velocity
+    double _dt = Config::dt * Config::N;
+    double _maxVelocity = -1.0;
+    // Cells of the level set flagged by narrowBand, by index in its blocks
+    std::vector<std::uint8_t> _band;
+    std::uint64_t _levelSetCells = 0;
+    // Field of the size of F the MacCormack corrections of the samples b
+    // are written into, before being swapped with F. They read the advected
+    // values around each sample, which other threads would be rewriting in
+    // place. Allocated on first use, outside of the parallel regions
+    Field<Real, std::uint16_t>& corrected(
+            const std::uint8_t b,
+            const Field<Real, std::uint16_t>& F
+        )
+    {
+        if (!_corrected[b])
+        {
+            _corrected[b] = std::make_unique<Field<Real, std::uint16_t>>(
+                    F.x(), F.y(), F.z());
+        }
+        return *_corrected[b];
+    }
+    std::array<std::unique_ptr<Field<Real, std::uint16_t>>, 4> _corrected;
+    // MacCormack corrections of the level set, by index in its blocks
+    std::vector<Real> _correctedLevelSet;
+    // Position of the samples b in a cell, in cells
+    static constexpr double _offsets[4][3] =
+    {
+        {0.5, 0.5, 0.5},
+        {0.0, 0.5, 0.5},
+        {0.5, 0.0, 0.5},
+        {0.5, 0.5, 0.0}
+    };
 };
 
 class Advect2D : public Advect
 {
  public:
     virtual void advect(
-            const StaggeredGrid<double, std::uint16_t>& grid,
-            Field<double, std::uint16_t>& F,
-            Field<double, std::uint16_t>& Fprev,
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            Field<Real, std::uint16_t>& F,
+            Field<Real, std::uint16_t>& Fprev,
             const std::uint8_t b
         ) override;
+    virtual void advect(
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            SparseField<Real, std::uint16_t>& F,
+            SparseField<Real, std::uint16_t>& Fprev
+        ) override;
+    virtual void advectVelocity(
+            StaggeredGrid<Real, std::uint16_t>& grid
+        ) override;
  private:
-    inline double interp(
-            const Field<double, std::uint16_t>& F,
-            const double x,
-            const double y
+    template<typename Grid>
+    inline double correct(
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            const Grid& F,
+            const Grid& Fprev,
+            const std::uint16_t i,
+            const std::uint16_t j,
+            const std::uint8_t b
+        ) const;
+    template<typename Function>
+    void forEachFace(
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            Function f
+        ) const;
+    template<typename Grid>
+    inline double correct(
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            const Grid& F,
+            const Grid& Fprev,
+            const std::uint8_t b,
+            const std::int32_t i,
+            const std::int32_t j,
+            const double u,
+            const double v
         ) const;
 };
 
@@ -37,16 +262,46 @@ class Advect3D : public Advect
 {
  public:
     virtual void advect(
-            const StaggeredGrid<double, std::uint16_t>& grid,
-            Field<double, std::uint16_t>& F,
-            Field<double, std::uint16_t>& Fprev,
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            Field<Real, std::uint16_t>& F,
+            Field<Real, std::uint16_t>& Fprev,
             const std::uint8_t b
         ) override;
+    virtual void advect(
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            SparseField<Real, std::uint16_t>& F,
+            SparseField<Real, std::uint16_t>& Fprev
+        ) override;
+    virtual void advectVelocity(
+            StaggeredGrid<Real, std::uint16_t>& grid
+        ) override;
  private:
-    inline double interp(
-            const Field<double, std::uint16_t>& F,
-            const double x,
-            const double y,
-            const double z
+    template<typename Grid>
+    inline double correct(
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            const Grid& F,
+            const Grid& Fprev,
+            const std::uint16_t i,
+            const std::uint16_t j,
+            const std::uint16_t k,
+            const std::uint8_t b
+        ) const;
+    template<typename Function>
+    void forEachFace(
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            Function f
+        ) const;
+    template<typename Grid>
+    inline double correct(
+            const StaggeredGrid<Real, std::uint16_t>& grid,
+            const Grid& F,
+            const Grid& Fprev,
+            const std::uint8_t b,
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k,
+            const double u,
+            const double v,
+            const double w
         ) const;
 };
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "./config.h"
+
+// Allocator of the storage of the fields. The elements are default
+// initialized, so resizing a vector of numbers does not write to its pages:
+// the field writes them itself with the static schedule of its kernels, and
+// each page is mapped on the NUMA node of the thread using it (first touch).
+// Storages of at least 2 MiB are aligned on 2 MiB pages and, with
+// Config::hugePages on Linux, backed by transparent huge pages
+template<typename T>
+class FieldAllocator
+{
+ public:
+    using value_type = T;
+
+    FieldAllocator() = default;
+    template<typename U>
+    FieldAllocator(const FieldAllocator<U>&) {}
+
+    T* allocate(const std::size_t n)
+    {
+        const std::size_t bytes = n * sizeof(T);
+        void* p = ::operator new(bytes, alignment(bytes));
+#ifdef __linux__
+        if (Config::hugePages && bytes >= _hugePage)
+        {
+            madvise(p, bytes, MADV_HUGEPAGE);
+        }
+#endif
+        return static_cast<T*>(p);
+    }
+    void deallocate(T* p, const std::size_t n)
+    {
+        ::operator delete(p, alignment(n * sizeof(T)));
+    }
+    template<typename U, typename... Args>
+    void construct(U* p, Args&&... args)
+    {
+        if constexpr (sizeof...(Args) == 0)
+        {
+            ::new(static_cast<void*>(p)) U;
+        }
+        else
+        {
+            ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...);
+        }
+    }
+
+    template<typename U>
+    bool operator==(const FieldAllocator<U>&) const
+    {
+        return true;
+    }
+
+ private:
+    constexpr static std::size_t _hugePage = 2 << 20;
+
+    static std::align_val_t alignment(const std::size_t bytes)
+    {
+        return std::align_val_t {bytes >= _hugePage ? _hugePage : 64};
+    }
+};
@@ -1,198 +1,575 @@
 #include "ConjugateGradient.h"
 
-// Use the Conjugate Gradient method to solve the Ax = b system
+using Clock = std::chrono::high_resolution_clock;
+
+// Seconds elapsed since start
+static inline double elapsed(const Clock::time_point& start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void pipelinedConjugateGradient(
+        const Eigen::SparseMatrix<double>& A,
+        Eigen::VectorXd& x,
+        const Eigen::VectorXd& r0,
+        StaggeredGrid<Real, std::uint16_t>& grid,
+        Multigrid& multigrid,
+        SolverReport& report
+    );
+
+// Use the Conjugate Gradient method to solve the Ax = b system,
+// x is used as the initial guess when warm starting.
+// Convergence and timings of the solve are written in report
 void ConjugateGradient(
         const Eigen::SparseMatrix<double>& A,
         Eigen::VectorXd& x,
         const Eigen::VectorXd& b,
-        StaggeredGrid<double, std::uint16_t>& grid
+        StaggeredGrid<Real, std::uint16_t>& grid,
+        Multigrid& multigrid,
+        SolverReport& report
     )
 {
     const std::uint64_t diagSize = x.size();
+    report = SolverReport();
+    report.activeCells = diagSize;
 
 #ifdef DEBUG
-    Eigen::SimplicialLLT<Eigen::SparseMatrix<double>> lltOfA(A);
-    if(lltOfA.info() == Eigen::NumericalIssue)
+    if (Config::pressureOperator == SPARSE_MATRIX)
     {
-        ERROR("DEBUG: Numerical Issue on the A matrix");
+        Eigen::SimplicialLLT<Eigen::SparseMatrix<double>> lltOfA(A);
+        if(lltOfA.info() == Eigen::NumericalIssue)
+        {
+            ERROR("DEBUG: Numerical Issue on the A matrix");
+        }
     }
 #endif
 
+    Clock::time_point start = Clock::now();
     if (Config::solver == PCG)
     {
         buildPrecondtioner(grid);
     }
+    else if (Config::solver == MGPCG)
+    {
+        multigrid.build(grid);
+    }
+    report.buildPreconditionerTime += elapsed(start);
 
     // Solving Ap = b
     Eigen::VectorXd r = b;
     if (r.isZero(0))
     {
         x = b;
+        report.converged = true;
+        return;
+    }
+    Eigen::VectorXd z = Eigen::VectorXd::Zero(diagSize);
+    if (Config::warmStart)
+    {
+        start = Clock::now();
+        applyLaplacian(A, x, z, grid);
+        report.spmvTime += elapsed(start);
+        r = r - z;
+    }
+    else
+    {
+        x = Eigen::VectorXd::Zero(diagSize);
+    }
+    report.initialResidualInf = r.lpNorm<Eigen::Infinity>();
+    report.initialResidualL2 = r.norm();
+    report.finalResidualInf = report.initialResidualInf;
+    report.finalResidualL2 = report.initialResidualL2;
+    if (report.initialResidualInf < 10e-5)
+    {
+        report.converged = true;
+        return;
+    }
+
+    if (Config::pipelinedCG)
+    {
+        pipelinedConjugateGradient(A, x, r, grid, multigrid, report);
         return;
     }
-    x = Eigen::VectorXd::Zero(diagSize);
 
-    Eigen::VectorXd z = x;
-    applyPreconditioner(r, z, grid);
+    start = Clock::now();
+    applyPreconditioner(r, z, grid, multigrid);
+    report.applyPreconditionerTime += elapsed(start);
     Eigen::VectorXd s = z;
     double sig = z.dot(r);
 
     for (std::uint64_t i = 0; i < static_cast<std::uint64_t>(b.size()); ++i)
     {
-        z = A * s;
+        start = Clock::now();
+        applyLaplacian(A, s, z, grid);
+        report.spmvTime += elapsed(start);
+
+        start = Clock::now();
         const double alpha = sig / s.dot(z);
         x = x + alpha * s;
         r = r - alpha * z;
-        if (r.lpNorm<Eigen::Infinity>() < 10e-5)
+        const double residual = r.lpNorm<Eigen::Infinity>();
+        report.vectorOpsTime += elapsed(start);
+
+        report.iterations = i+1;
+        report.residuals.push_back(residual);
+        report.finalResidualInf = residual;
+        if (residual < 10e-5)
         {
+            report.converged = true;
             break;
         }
-        applyPreconditioner(r, z, grid);
+
+        start = Clock::now();
+        applyPreconditioner(r, z, grid, multigrid);
+        report.applyPreconditionerTime += elapsed(start);
+
+        start = Clock::now();
         const double signew = z.dot(r);
         const double beta = signew / sig;
         s = z + beta * s;
         sig = signew;
+        report.vectorOpsTime += elapsed(start);
     }
+    report.finalResidualL2 = r.norm();
 }
 
-// Create the preconditioner in the "_precon" grid of "grid"
-void buildPrecondtioner(StaggeredGrid<double, std::uint16_t>& grid)
+// Write the report of a pressure solve as one JSON line
+void writeReport(
+        std::ostream& os,
+        const SolverReport& report,
+        const std::uint64_t frame
+    )
+{
+    os << std::setprecision(9)
+        << "{\"frame\": " << frame
+        << ", \"solver\": " << Config::solver
+        << ", \"activeCells\": " << report.activeCells
+        << ", \"iterations\": " << report.iterations
+        << ", \"converged\": " << (report.converged ? "true" : "false")
+        << ", \"initialResidualInf\": " << report.initialResidualInf
+        << ", \"initialResidualL2\": " << report.initialResidualL2
+        << ", \"finalResidualInf\": " << report.finalResidualInf
+        << ", \"finalResidualL2\": " << report.finalResidualL2
+        << ", \"buildPreconditionerTime\": " << report.buildPreconditionerTime
+        << ", \"spmvTime\": " << report.spmvTime
+        << ", \"applyPreconditionerTime\": "
+            << report.applyPreconditionerTime
+        << ", \"vectorOpsTime\": " << report.vectorOpsTime
+        << ", \"residuals\": [";
+    for (std::uint64_t it = 0; it < report.residuals.size(); ++it)
+    {
+        os << (it > 0 ? ", " : "") << report.residuals[it];
+    }
+    os << "]}" << std::endl;
+}
+
+// Row of the matrix-free Laplacian applied to s, for the liquid
+// cell n = (i, j, k) of pressure ID "id"
+static inline double laplacianAt(
+        const StaggeredGrid<Real, std::uint16_t>& grid,
+        const double* s,
+        const std::uint64_t n,
+        const std::uint16_t i,
+        const std::uint16_t j,
+        const std::uint16_t k,
+        const std::uint64_t id
+    )
 {
-    for (std::int16_t k = 0; k < grid._surface.z(); ++k)
+    // The cell-centered fields share the same layout, so the indices of
+    // the neighbors are computed once, without any range check
+    const auto& L = grid._pressureID.layout();
+    const std::uint64_t prevI = L.neighbor<-1, 0, 0>(n, i, j, k);
+    const std::uint64_t prevJ = L.neighbor<0, -1, 0>(n, i, j, k);
+    const std::uint64_t nextJ = L.neighbor<0, 1, 0>(n, i, j, k);
+    const std::uint64_t prevK = L.neighbor<0, 0, -1>(n, i, j, k);
+    const std::uint64_t nextK = L.neighbor<0, 0, 1>(n, i, j, k);
+    // Off-diagonal stencils are only set between two liquid
+    // cells, and liquid cells along i have consecutive IDs
+    double v = grid.nonSolidNeighbors(i, j, k) * s[id-1];
+    if (i > 0 && grid._Ax(prevI) != 0.0)
     {
-        for (std::int16_t j = 0; j < grid._surface.y(); ++j)
+        v += grid._Ax(prevI) * s[id-2];
+    }
+    if (grid._Ax(n) != 0.0)
+    {
+        v += grid._Ax(n) * s[id];
+    }
+    if (j > 0 && grid._Ay(prevJ) != 0.0)
+    {
+        v += grid._Ay(prevJ) * s[grid._pressureID(prevJ)-1];
+    }
+    if (grid._Ay(n) != 0.0)
+    {
+        v += grid._Ay(n) * s[grid._pressureID(nextJ)-1];
+    }
+    if (k > 0 && grid._Az(prevK) != 0.0)
+    {
+        v += grid._Az(prevK) * s[grid._pressureID(prevK)-1];
+    }
+    if (grid._Az(n) != 0.0)
+    {
+        v += grid._Az(n) * s[grid._pressureID(nextK)-1];
+    }
+    return v;
+}
+
+// Compute z = As, either with the assembled sparse matrice
+// or directly from the stencils stored in the grid (matrix-free)
+void applyLaplacian(
+        const Eigen::SparseMatrix<double>& A,
+        const Eigen::VectorXd& s,
+        Eigen::VectorXd& z,
+        const StaggeredGrid<Real, std::uint16_t>& grid
+    )
+{
+    if (Config::pressureOperator == SPARSE_MATRIX)
+    {
+        z = A * s;
+        return;
+    }
+    const auto& cells = grid.activeList();
+    const std::int64_t size = cells.size();
+    #pragma omp parallel for
+    for (std::int64_t c = 0; c < size; ++c)
+    {
+        const auto& cell = cells[c];
+        z.coeffRef(c) = laplacianAt(
+                grid, s.data(), cell.n, cell.i, cell.j, cell.k, c+1);
+    }
+}
+
+// Compute w = Au along with the (r, u) and (w, u) dot products and the
+// inf-norm of r. With the matrix-free operator the three reductions are
+// made in the same sweep as the product, so u, w and r are only streamed once
+static void applyLaplacianDot(
+        const Eigen::SparseMatrix<double>& A,
+        const Eigen::Ref<const Eigen::VectorXd>& u,
+        Eigen::Ref<Eigen::VectorXd> w,
+        const Eigen::Ref<const Eigen::VectorXd>& r,
+        const StaggeredGrid<Real, std::uint16_t>& grid,
+        double& ru,
+        double& wu,
+        double& rInf
+    )
+{
+    double gamma = 0.0;
+    double delta = 0.0;
+    double residual = 0.0;
+    if (Config::pressureOperator == SPARSE_MATRIX)
+    {
+        w = A * u;
+        const double* pu = u.data();
+        const double* pw = w.data();
+        const double* pr = r.data();
+        const std::int64_t size = u.size();
+        #pragma omp parallel for reduction(+:gamma, delta) \
+            reduction(max:residual)
+        for (std::int64_t n = 0; n < size; ++n)
         {
-            for (std::int16_t i = 0; i < grid._surface.x(); ++i)
-            {
-                if (grid._surface.label(i, j, k) & LIQUID)
-                {
-                    double  a = 0.0,  b = 0.0,  c = 0.0;
-                    double i0 = 0.0, i1 = 0.0, i2 = 0.0, i3 = 0.0;
-                    double j0 = 0.0, j1 = 0.0, j2 = 0.0, j3 = 0.0;
-                    double k0 = 0.0, k1 = 0.0, k2 = 0.0, k3 = 0.0;
-                    if (i > 0.0)
-                    {
-                        a = std::pow(
-                                grid._Ax(i-1, j, k) * grid._precon(i-1, j, k),
-                                2
-                            );
-                        i0 = grid._Ax(i-1, j, k);
-                        i1 = grid._Ay(i-1, j, k);
-                        i2 = grid._Az(i-1, j, k);
-                        i3 = std::pow(grid._precon(i-1, j, k), 2);
-                    }
-                    if (j > 0.0)
-                    {
-                        b = std::pow(
-                                grid._Ay(i, j-1, k) * grid._precon(i, j-1, k),
-                                2
-                            );
-                        j0 = grid._Ay(i, j-1, k);
-                        j1 = grid._Ax(i, j-1, k);
-                        j2 = grid._Az(i, j-1, k);
-                        j3 = std::pow(grid._precon(i, j-1, k), 2);
-                    }
-                    if (k > 0.0)
-                    {
-                        c = std::pow(
-                                grid._Az(i, j, k-1) * grid._precon(i, j, k-1),
-                                2
-                            );
-                        k0 = grid._Az(i, j, k-1);
-                        k1 = grid._Ax(i, j, k-1);
-                        k2 = grid._Ay(i, j, k-1);
-                        k3 = std::pow(grid._precon(i, j, k-1), 2);
-                    }
-
-                    double e = grid._Adiag(i, j, k) - a - b - c
-                        - 0.97 * (
-                                i0 * (i1 + i2) * i3
-                            +   j0 * (j1 + j2) * j3
-                            +   k0 * (k1 + k2) * k3
-                        );
-
-                    if (e < 0.25 * grid._Adiag(i, j, k))
-                    {
-                        e = grid._Adiag(i, j, k);
-                    }
-                    grid._precon(i, j, k) = 1.0/std::sqrt(e);
-                }
-            }
+            gamma += pr[n] * pu[n];
+            delta += pw[n] * pu[n];
+            residual = std::max(residual, std::abs(pr[n]));
         }
+        ru = gamma;
+        wu = delta;
+        rInf = residual;
+        return;
+    }
+    const auto& cells = grid.activeList();
+    const std::int64_t size = cells.size();
+    #pragma omp parallel for reduction(+:gamma, delta) reduction(max:residual)
+    for (std::int64_t c = 0; c < size; ++c)
+    {
+        const auto& cell = cells[c];
+        const double v = laplacianAt(
+                grid, u.data(), cell.n, cell.i, cell.j, cell.k, c+1);
+        w.coeffRef(c) = v;
+        gamma += r.coeff(c) * u.coeff(c);
+        delta += v * u.coeff(c);
+        residual = std::max(residual, std::abs(r.coeff(c)));
     }
+    ru = gamma;
+    wu = delta;
+    rInf = residual;
 }
 
-// Apply the previously computed preconditioner
-// to the z vector to speed up CG convergence
-void applyPreconditioner(
-        const Eigen::VectorXd& r,
-        Eigen::VectorXd& z,
-        StaggeredGrid<double, std::uint16_t>& grid
+// Pipelined (Chronopoulos-Gear) variant of the preconditioned CG loop,
+// starting from the residual r0 of the initial guess x. The recurrences on
+// s = Ap and w = Au let the direction, solution and residual updates be
+// fused in one sweep, and the two dot products and the inf-norm of the
+// residual be computed along with w = Au, so each iteration only has a single
+// global reduction. The convergence test is lagged behind the preconditioner
+// of the next iteration, which gives the same iterations and solution.
+// The vectors r, u, w, p and s share one allocation, staggered by a few cache
+// lines: large vectors are all page aligned, and streaming them together at
+// the same offsets makes their loads and stores alias each other
+static void pipelinedConjugateGradient(
+        const Eigen::SparseMatrix<double>& A,
+        Eigen::VectorXd& x,
+        const Eigen::VectorXd& r0,
+        StaggeredGrid<Real, std::uint16_t>& grid,
+        Multigrid& multigrid,
+        SolverReport& report
     )
 {
-    if (Config::solver == CG)
+    const std::int64_t size = x.size();
+    const std::int64_t stride = size + 72;
+    Eigen::VectorXd work = Eigen::VectorXd::Zero(5*stride);
+    Eigen::Map<Eigen::VectorXd> r(work.data() + 8, size);
+    Eigen::Map<Eigen::VectorXd> u(r.data() + stride, size);
+    Eigen::Map<Eigen::VectorXd> w(u.data() + stride, size);
+    Eigen::Map<Eigen::VectorXd> p(w.data() + stride, size);
+    Eigen::Map<Eigen::VectorXd> s(p.data() + stride, size);
+    r = r0;
+
+    Clock::time_point start = Clock::now();
+    applyPreconditioner(r, u, grid, multigrid);
+    report.applyPreconditionerTime += elapsed(start);
+    double gamma = 0.0;
+    double delta = 0.0;
+    double residual = 0.0;
+    start = Clock::now();
+    applyLaplacianDot(A, u, w, r, grid, gamma, delta, residual);
+    report.spmvTime += elapsed(start);
+    double alpha = gamma / delta;
+    double beta = 0.0;
+
+    double* px = x.data();
+    double* pr = r.data();
+    double* pp = p.data();
+    double* ps = s.data();
+    const double* pu = u.data();
+    const double* pw = w.data();
+    for (std::int64_t i = 0; i < size; ++i)
     {
-        z = r;
+        start = Clock::now();
+        #pragma omp parallel for
+        for (std::int64_t n = 0; n < size; ++n)
+        {
+            pp[n] = pu[n] + beta * pp[n];
+            ps[n] = pw[n] + beta * ps[n];
+            px[n] += alpha * pp[n];
+            pr[n] -= alpha * ps[n];
+        }
+        report.vectorOpsTime += elapsed(start);
+
+        start = Clock::now();
+        applyPreconditioner(r, u, grid, multigrid);
+        report.applyPreconditionerTime += elapsed(start);
+
+        start = Clock::now();
+        const double gammaOld = gamma;
+        applyLaplacianDot(A, u, w, r, grid, gamma, delta, residual);
+        report.spmvTime += elapsed(start);
+
+        report.iterations = i+1;
+        report.residuals.push_back(residual);
+        report.finalResidualInf = residual;
+        if (residual < 10e-5)
+        {
+            report.converged = true;
+            break;
+        }
+        beta = gamma / gammaOld;
+        alpha = gamma / (delta - beta * gamma / alpha);
+    }
+    report.finalResidualL2 = r.norm();
+}
+
+// Visit the liquid cells of the grid with f(i, j, k), either in the
+// lexicographic order of the active list or by parallel wavefronts. A cell
+// only depends on its i-1, j-1 and k-1 neighbors (i+1, j+1 and k+1 for the
+// backward substitution), so in 3D the rows of constant j+k are independent
+// and are visited in parallel, each row being walked along i. In 2D the cells
+// of constant i+j are used instead. Both orders give the same result as the
+// serial MIC(0) substitutions.
+template<typename Kernel>
+static void sweep(
+        const StaggeredGrid<Real, std::uint16_t>& grid,
+        const bool reverse,
+        Kernel f
+    )
+{
+    const auto& cells = grid.activeList();
+    const std::int64_t size = cells.size();
+    if (!Config::parallelPreconditioner)
+    {
+        for (std::int64_t c = 0; c < size; ++c)
+        {
+            const auto& cell = cells[reverse ? size-1-c : c];
+            f(cell.i, cell.j, cell.k);
+        }
         return;
     }
-    grid._q.reset();
-    grid._z.reset();
-    for (std::int16_t k = 0; k < grid._surface.z(); ++k)
+
+    const std::int32_t X = grid._surface.x();
+    const std::int32_t Y = grid._surface.y();
+    const std::int32_t Z = grid._surface.z();
+    if (Z == 1)
     {
-        for (std::int16_t j = 0; j < grid._surface.y(); ++j)
+        const auto& fronts = grid.activeFronts();
+        const auto& order = grid.frontOrder();
+        const std::int32_t nbFronts = X+Y-1;
+        #pragma omp parallel
+        for (std::int32_t front = 0; front < nbFronts; ++front)
         {
-            for (std::int16_t i = 0; i < grid._surface.x(); ++i)
+            const std::int32_t d = reverse ? nbFronts-1-front : front;
+            #pragma omp for schedule(static)
+            for (std::uint64_t c = fronts[d]; c < fronts[d+1]; ++c)
             {
-                if (grid._pressureID(i, j, k) > 0)
-                {
-                    const double a = i > 0
-                        ?   (grid._Ax(i-1, j, k) *
-                            grid._precon(i-1, j, k) *
-                            grid._q(i-1, j, k))
-                        : 0.0;
-                    const double b = j > 0
-                        ?   (grid._Ay(i, j-1, k) *
-                            grid._precon(i, j-1, k) *
-                            grid._q(i, j-1, k))
-                        : 0.0;
-                    const double c = k > 0
-                        ?   (grid._Az(i, j, k-1) *
-                            grid._precon(i, j, k-1) *
-                            grid._q(i, j, k-1))
-                        : 0.0;
-                    const double t =
-                        r(grid._pressureID(i, j, k)-1) - a - b - c;
-                    grid._q(i, j, k) = t * grid._precon(i, j, k);
-                }
+                const auto& cell = cells[order[c]];
+                f(cell.i, cell.j, cell.k);
             }
         }
+        return;
     }
-    for (std::int16_t k = grid._surface.z()-1; k >= 0; --k)
+
+    const auto& rows = grid.activeRows();
+    const std::int32_t nbFronts = Y+Z-1;
+    #pragma omp parallel
+    for (std::int32_t front = 0; front < nbFronts; ++front)
     {
-        for (std::int16_t j = grid._surface.y()-1; j >= 0; --j)
+        const std::int32_t d = reverse ? nbFronts-1-front : front;
+        #pragma omp for schedule(static)
+        for (std::int32_t k = std::max(0, d-(Y-1));
+                k <= std::min(Z-1, d);
+                ++k)
         {
-            for (std::int16_t i = grid._surface.x()-1; i >= 0; --i)
+            const std::uint64_t row = (d-k) + static_cast<std::uint64_t>(k)*Y;
+            const std::uint64_t begin = rows[row];
+            const std::uint64_t end = rows[row+1];
+            for (std::uint64_t c = begin; c < end; ++c)
             {
-                if (grid._surface.label(i, j, k) & LIQUID)
-                {
-                    const double a =
-                        grid._Ax(i, j, k) *
-                        grid._precon(i, j, k) *
-                        grid._z(i+1, j, k);
-                    const double b =
-                        grid._Ay(i, j, k) *
-                        grid._precon(i, j, k) *
-                        grid._z(i, j+1, k);
-                    const double c =
-                        grid._Az(i, j, k) *
-                        grid._precon(i, j, k) *
-                        grid._z(i, j, k+1);
-
-                    const double t = grid._q(i, j, k) - a - b - c;
-                    grid._z(i, j, k) = t * grid._precon(i, j, k);
-                    z(grid._pressureID(i, j, k)-1) = t * grid._precon(i, j, k);
-                }
+                const auto& cell = cells[reverse ? begin+end-1-c : c];
+                f(cell.i, cell.j, cell.k);
             }
         }
     }
 }
+
+// Create the preconditioner in the "_precon" grid of "grid"
+void buildPrecondtioner(StaggeredGrid<Real, std::uint16_t>& grid)
+{
+    sweep(grid, false,
+        [&grid](const std::int32_t i, const std::int32_t j, const std::int32_t k)
+        {
+            double  a = 0.0,  b = 0.0,  c = 0.0;
+            double i0 = 0.0, i1 = 0.0, i2 = 0.0, i3 = 0.0;
+            double j0 = 0.0, j1 = 0.0, j2 = 0.0, j3 = 0.0;
+            double k0 = 0.0, k1 = 0.0, k2 = 0.0, k3 = 0.0;
+            if (i > 0)
+            {
+                a = std::pow(
+                        grid._Ax(i-1, j, k) * grid._precon(i-1, j, k),
+                        2
+                    );
+                i0 = grid._Ax(i-1, j, k);
+                i1 = grid._Ay(i-1, j, k);
+                i2 = grid._Az(i-1, j, k);
+                i3 = std::pow(grid._precon(i-1, j, k), 2);
+            }
+            if (j > 0)
+            {
+                b = std::pow(
+                        grid._Ay(i, j-1, k) * grid._precon(i, j-1, k),
+                        2
+                    );
+                j0 = grid._Ay(i, j-1, k);
+                j1 = grid._Ax(i, j-1, k);
+                j2 = grid._Az(i, j-1, k);
+                j3 = std::pow(grid._precon(i, j-1, k), 2);
+            }
+            if (k > 0)
+            {
+                c = std::pow(
+                        grid._Az(i, j, k-1) * grid._precon(i, j, k-1),
+                        2
+                    );
+                k0 = grid._Az(i, j, k-1);
+                k1 = grid._Ax(i, j, k-1);
+                k2 = grid._Ay(i, j, k-1);
+                k3 = std::pow(grid._precon(i, j, k-1), 2);
+            }
+
+            double e = grid._Adiag(i, j, k) - a - b - c
+                - 0.97 * (
+                        i0 * (i1 + i2) * i3
+                    +   j0 * (j1 + j2) * j3
+                    +   k0 * (k1 + k2) * k3
+                );
+
+            if (e < 0.25 * grid._Adiag(i, j, k))
+            {
+                e = grid._Adiag(i, j, k);
+            }
+            grid._precon(i, j, k) = 1.0/std::sqrt(e);
+        });
+}
+
+// Apply the previously computed preconditioner
+// to the z vector to speed up CG convergence
+void applyPreconditioner(
+        const Eigen::Ref<const Eigen::VectorXd>& r,
+        Eigen::Ref<Eigen::VectorXd> z,
+        StaggeredGrid<Real, std::uint16_t>& grid,
+        Multigrid& multigrid
+    )
+{
+    if (Config::solver == CG)
+    {
+        z = r;
+        return;
+    }
+    if (Config::solver == MGPCG)
+    {
+        multigrid.apply(r, z, grid);
+        return;
+    }
+    // Neighbors are only read when liquid, so "_q" and "_z"
+    // never need to be cleared from a solve to the other
+    sweep(grid, false,
+        [&grid, &r](const std::int32_t i, const std::int32_t j, const std::int32_t k)
+        {
+            const double a = i > 0 && grid._pressureID(i-1, j, k) > 0
+                ?   (grid._Ax(i-1, j, k) *
+                    grid._precon(i-1, j, k) *
+                    grid._q(i-1, j, k))
+                : 0.0;
+            const double b = j > 0 && grid._pressureID(i, j-1, k) > 0
+                ?   (grid._Ay(i, j-1, k) *
+                    grid._precon(i, j-1, k) *
+                    grid._q(i, j-1, k))
+                : 0.0;
+            const double c = k > 0 && grid._pressureID(i, j, k-1) > 0
+                ?   (grid._Az(i, j, k-1) *
+                    grid._precon(i, j, k-1) *
+                    grid._q(i, j, k-1))
+                : 0.0;
+            const double t =
+                r(grid._pressureID(i, j, k)-1) - a - b - c;
+            grid._q(i, j, k) = t * grid._precon(i, j, k);
+        });
+    sweep(grid, true,
+        [&grid, &z](const std::int32_t i, const std::int32_t j, const std::int32_t k)
+        {
+            const double a = grid._Ax(i, j, k) != 0.0
+                ?   (grid._Ax(i, j, k) *
+                    grid._precon(i, j, k) *
+                    grid._z(i+1, j, k))
+                : 0.0;
+            const double b = grid._Ay(i, j, k) != 0.0
+                ?   (grid._Ay(i, j, k) *
+                    grid._precon(i, j, k) *
+                    grid._z(i, j+1, k))
+                : 0.0;
+            const double c = grid._Az(i, j, k) != 0.0
+                ?   (grid._Az(i, j, k) *
+                    grid._precon(i, j, k) *
+                    grid._z(i, j, k+1))
+                : 0.0;
+
+            const double t = grid._q(i, j, k) - a - b - c;
+            grid._z(i, j, k) = t * grid._precon(i, j, k);
+            z(grid._pressureID(i, j, k)-1) = t * grid._precon(i, j, k);
+        });
+}
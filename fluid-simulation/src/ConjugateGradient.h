@@ -1,21 +1,58 @@
 #pragma once
 
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
 #include "./Eigen/Sparse"
 #include "./types.h"
 #include "./config.h"
 #include "./StaggeredGrid.h"
+#include "./Multigrid.h"
+
+// Convergence and timings (in seconds) of one pressure solve
+struct SolverReport
+{
+    std::uint64_t activeCells = 0;
+    std::uint64_t iterations = 0;
+    bool converged = false;
+    double initialResidualInf = 0.0;
+    double initialResidualL2 = 0.0;
+    double finalResidualInf = 0.0;
+    double finalResidualL2 = 0.0;
+    double buildPreconditionerTime = 0.0;
+    double spmvTime = 0.0;
+    double applyPreconditionerTime = 0.0;
+    double vectorOpsTime = 0.0;
+    std::vector<double> residuals;
+};
 
 void ConjugateGradient(
         const Eigen::SparseMatrix<double>& A,
         Eigen::VectorXd& x,
         const Eigen::VectorXd& b,
-        StaggeredGrid<double, std::uint16_t>& grid
+        StaggeredGrid<Real, std::uint16_t>& grid,
+        Multigrid& multigrid,
+        SolverReport& report
     );
-void applyPreconditioner(
-        const Eigen::VectorXd& r,
+void writeReport(
+        std::ostream& os,
+        const SolverReport& report,
+        const std::uint64_t frame
+    );
+void applyLaplacian(
+        const Eigen::SparseMatrix<double>& A,
+        const Eigen::VectorXd& s,
         Eigen::VectorXd& z,
-        StaggeredGrid<double, std::uint16_t>& grid
+        const StaggeredGrid<Real, std::uint16_t>& grid
+    );
+void applyPreconditioner(
+        const Eigen::Ref<const Eigen::VectorXd>& r,
+        Eigen::Ref<Eigen::VectorXd> z,
+        StaggeredGrid<Real, std::uint16_t>& grid,
+        Multigrid& multigrid
     );
 void buildPrecondtioner(
-        StaggeredGrid<double, std::uint16_t>& grid
+        StaggeredGrid<Real, std::uint16_t>& grid
     );
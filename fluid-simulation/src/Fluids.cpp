@@ -1,5 +1,15 @@
 #include "Fluids.h"
 
+#include <omp.h>
+
+using Clock = std::chrono::high_resolution_clock;
+
+// Seconds elapsed since start
+static inline double elapsed(const Clock::time_point& start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
 // Initialise the simulation tools
 Fluids::Fluids()
 {
@@ -20,14 +30,37 @@ Fluids::Fluids()
             _projection = std::make_unique<Project3D>(_grid);
             break;
     }
+    _layerFound.resize(omp_get_max_threads());
+    if (Config::solverReport)
+    {
+        _solverReport.open("solver-report.jsonl", std::ios::trunc);
+        if (!_solverReport.is_open())
+        {
+            ERROR("Failed to open solver-report.jsonl");
+        }
+    }
 }
 
-// Update the simulation by one step
+// Update the simulation by one frame: one step of Config::dt, or substeps
+// up to Config::frameTime in adaptive mode
 void Fluids::update(const std::uint64_t iteration)
 {
     _iteration = iteration;
-    
-    step();
+
+    auto& report = _timeStepReport;
+    report.nbSubsteps = 0;
+    double remaining = Config::adaptiveTimeStep ? Config::frameTime
+        : Config::dt;
+    while (remaining > 0.0)
+    {
+        // The last substep takes the remaining time exactly, so it ends at 0
+        remaining -= step(remaining);
+        report.nbSubsteps++;
+    }
+    if (Config::solverReport)
+    {
+        writeReport(_solverReport, _projection->report(), _iteration);
+    }
     if (Config::renderFrames)
     {
         switch (Config::dim)
@@ -42,8 +75,9 @@ void Fluids::update(const std::uint64_t iteration)
     }
 }
 
-// Simulation step aka Navier-Stokes solving
-void Fluids::step()
+// Simulation step aka Navier-Stokes solving, of at most remaining seconds.
+// Returns the time step taken
+double Fluids::step(const double remaining)
 {
     for (std::uint16_t k = 0; k < _grid._surface.z(); ++k)
     {
@@ -57,7 +91,7 @@ void Fluids::step()
                     );
                 if (dist < 6 && (k == 1 || k == 2))
                 {
-                    _grid._surface(i, j, k) = -10;
+                    _grid._surface.set(i, j, k, -10);
                     _grid._W(i, j, k) = 5000;
                     _grid._W(i, j, k+1) = 5000;
                     _grid._V(i, j, k) = 7000;
@@ -67,64 +101,171 @@ void Fluids::step()
                         (k == _grid._surface.z()-2 || k == _grid._surface.z()-3)
                     )
                 {
-                    _grid._surface(i, j, k) = -10;
+                    _grid._surface.set(i, j, k, -10);
                     _grid._W(i, j, k+1) = -5100;
                     _grid._W(i, j, k) = -5100;
                     _grid._V(i, j, k) = 7000;
                     _grid._V(i, j, k-1) = 7000;
                 }
-                else
-                {
-                    if (_iteration == 0)
-                    {
-                        _grid._surface(i, j, k) = 10;
-                    }
-                }
             }
         }
     }
 
     // Set labels to fields (inside/outside/..)
-    _grid._surface.setLabels(_grid._U, _grid._V, _grid._W);
+    _grid.setLabels();
 
-    // Extrapolate the velocity field
-    extrapolate(_grid._U, _grid._UPrev);
-    extrapolate(_grid._V, _grid._VPrev);
-    extrapolate(_grid._W, _grid._WPrev);
+    // Extrapolate the velocity field on a band around the liquid
+    extrapolate(_grid._U, Config::extrapolationBand);
+    extrapolate(_grid._V, Config::extrapolationBand);
+    extrapolate(_grid._W, Config::extrapolationBand);
+    _grid._U.fillHalo(HALO_CONSTANT);
+    _grid._V.fillHalo(HALO_CONSTANT);
+    _grid._W.fillHalo(HALO_CONSTANT);
 
-    // Advect level-set everywhere using the fully extrapolated velocity
-    _advection->advect(_grid, _grid._surface, _grid._surfacePrev, 0);
-    redistancing(8, _grid._surface, _grid._surfacePrev);
+    // Pick the time step moving the fastest liquid face by cfl cells. A
+    // step between the remaining time and half of it is halved, so the
+    // frame does not end with a sliver substep
+    double dt = remaining;
+    if (Config::adaptiveTimeStep)
+    {
+        auto& report = _timeStepReport;
+        report.maxVelocity = maxVelocity();
+        dt = Config::dtMax;
+        if (report.maxVelocity > 0.0)
+        {
+            dt = std::clamp(Config::cfl / (report.maxVelocity * Config::N),
+                    Config::dtMin, Config::dtMax);
+        }
+        if (dt >= remaining)
+        {
+            dt = remaining;
+        }
+        else if (2.0 * dt > remaining)
+        {
+            dt = 0.5 * remaining;
+        }
+    }
+    _advection->setTimeStep(dt);
+    _timeStepReport.dt = dt;
+    _timeStepReport.time += dt;
 
-    // Advect velocity everywhere using the fully extrapolated velocity
-    _advection->advect(_grid, _grid._U, _grid._UPrev, 1);
-    _advection->advect(_grid, _grid._V, _grid._VPrev, 2);
-    _advection->advect(_grid, _grid._W, _grid._WPrev, 3);
+    // Advect level-set near the interface using the extrapolated
+    // velocity, after activating the tiles the interface can move into.
+    // The narrow band follows from the largest displacement of the step,
+    // bounded by the largest velocity of the liquid and of the extrapolated
+    // faces, the other ones being zeroed by the extrapolation
+    _grid._surface.dilate();
+    if (Config::narrowBandAdvection)
+    {
+        _advection->setMaxVelocity(Config::adaptiveTimeStep
+                ? _timeStepReport.maxVelocity : maxVelocity());
+    }
+    const auto levelSetStart = Clock::now();
+    _advection->advect(_grid, _grid._surface, _grid._surfacePrev);
+    _advectionReport.levelSetTime = elapsed(levelSetStart);
+    _advectionReport.levelSetCells = _advection->levelSetCells();
+
+    // Redistance the level-set only once its gradient drifted from 1, or
+    // every redistancingInterval substeps, or every step without a drift
+    // threshold. Otherwise the tiles the interface left are still
+    // deactivated
+    auto& report = _redistancingReport;
+    report.drift = gradientDrift(_grid._surface);
+    const bool due = Config::redistancingInterval > 0 && _nbSteps
+        >= _lastRedistancing + Config::redistancingInterval;
+    report.redistanced = due || Config::redistancingDrift <= 0.0
+        || report.drift > Config::redistancingDrift;
+    if (report.redistanced)
+    {
+        redistancing(8, _grid._surface);
+        report.driftAfter = gradientDrift(_grid._surface);
+        report.nbRedistanced++;
+        _lastRedistancing = _nbSteps;
+    }
+    else
+    {
+        _grid._surface.prune();
+        report.nbSkipped++;
+    }
+
+    // Advect velocity everywhere using the extrapolated velocity, in one
+    // pass, or component by component where each component is read by the
+    // advection of the next ones
+    auto& timings = _advectionReport;
+    const auto start = Clock::now();
+    if (Config::fusedAdvection)
+    {
+        _advection->advectVelocity(_grid);
+        _grid._U.fillHalo(HALO_CONSTANT);
+        _grid._V.fillHalo(HALO_CONSTANT);
+        timings.uTime = timings.vTime = timings.wTime = 0.0;
+    }
+    else
+    {
+        _advection->advect(_grid, _grid._U, _grid._UPrev, 1);
+        _grid._U.fillHalo(HALO_CONSTANT);
+        timings.uTime = elapsed(start);
+        _advection->advect(_grid, _grid._V, _grid._VPrev, 2);
+        _grid._V.fillHalo(HALO_CONSTANT);
+        timings.vTime = elapsed(start) - timings.uTime;
+        _advection->advect(_grid, _grid._W, _grid._WPrev, 3);
+        timings.wTime = elapsed(start) - timings.uTime - timings.vTime;
+    }
+    timings.velocityTime = elapsed(start);
 
     // Set labels to fields (inside/outside/..)
-    _grid._surface.setLabels(_grid._U, _grid._V, _grid._W);
+    _grid.setLabels();
 
     // Add external forces
-    addForces();
+    addForces(dt);
 
     // Tag the cells that are inside the liquids and assign integer labels
     _grid.tagActiveCells();
 
     // Ensure incompressibility
     _projection->project();
+
+    _nbSteps++;
+    return dt;
 }
 
-// Add forces to the velocity field (gravity for example)
-void Fluids::addForces()
+// Largest velocity component over the faces of the liquid and of the
+// extrapolation band, the faces farther in the air are zeroed by the
+// extrapolation, so it bounds every velocity the advection reads
+double Fluids::maxVelocity() const
 {
-    const double G = 150.0;
+    double umax = 0.0;
+    for (const auto* F : {&_grid._U, &_grid._V, &_grid._W})
+    {
+        const std::int64_t size = F->maxIt();
+        #pragma omp parallel for reduction(max:umax)
+        for (std::int64_t n = 0; n < size; ++n)
+        {
+            if (F->checked(n))
+            {
+                umax = std::max(umax,
+                        std::abs(static_cast<double>((*F)(n))));
+            }
+        }
+    }
+    return umax;
+}
+
+// Add forces to the velocity field (gravity for example) over a step of dt
+// seconds, on the LIQUID faces only: it runs after the relabelling, so the
+// faces of the extrapolation band are EMPTY again, and the extrapolation of
+// the next step overwrites them before the advection reads them. G is the
+// velocity change over a step of Config::dt
+void Fluids::addForces(const double dt)
+{
+    const double G = 150.0 * (dt / Config::dt);
     for (std::uint16_t k = 0; k < _grid._V.z(); ++k)
     {
         for (std::uint16_t j = 0; j < _grid._V.y(); ++j)
         {
             for (std::uint16_t i = 0; i < _grid._V.x(); ++i)
             {
-                if (!(_grid._V.label(i, j, k) & SOLID))
+                if (_grid._V.checked(i, j, k))
                 {
                     _grid._V(i, j, k) -= G;
                 }
@@ -133,205 +274,548 @@ void Fluids::addForces()
     }
 }
 
-// Extrapolate the field F, nbIte times
+// Extrapolate the field F on nbLayers layers of cells around the liquid,
+// or until every cell is reached if nbLayers is 0. Each layer is a list of
+// the EMPTY cells next to the previous one, which get the average value of
+// their LIQUID or EXTRAPOLATED neighbors, so past the first pass over the
+// labels the cost only depends on the cells of the band. The cells out of
+// the band keep the EMPTY label and are zeroed during the first pass, so the
+// advection reading them never picks up stale velocities. The neighbors are
+// only read inside the level set grid
 void Fluids::extrapolate(
-        Field<double, std::uint16_t>& F,
-        Field<double, std::uint16_t>& Ftemp,
-        std::uint16_t nbIte
-    ) const
+        Field<Real, std::uint16_t>& F,
+        const std::uint16_t nbLayers
+    )
 {
-    // Use Ftemp to store each extrapolation step
-    // For each cell, if its neighbors are either LIQUID, SOLID or EXTRAPOLATED
-    // then set it to EXTRAPOLATED with the average value of its valid neighbors
-    std::uint16_t it = 0;
-    std::uint64_t nbNeg = 0;
-    do
-    {
-        nbNeg = 0;
-        #pragma omp parallel for
-        for (std::uint64_t n = 0; n < F.maxIt(); ++n)
+    const std::int32_t X = _grid._surface.x();
+    const std::int32_t Y = _grid._surface.y();
+    const std::int32_t Z = _grid._surface.z();
+    const auto& L = F.layout();
+    // Whether the neighbor of (i,j,k) along each direction is read
+    const auto reads = [X, Y, Z](const std::int32_t i, const std::int32_t j,
+            const std::int32_t k, const std::int32_t dir)
+    {
+        switch (dir)
         {
-            const std::uint64_t xy = static_cast<std::uint64_t>(F.x()*F.y());
-            const std::uint64_t m = n % xy;
-            const std::uint16_t i = m % F.x();
-            const std::uint16_t j = m / F.x();
-            const std::uint16_t k = n / xy;
+            case 0: return i < X-1;
+            case 1: return i > 0;
+            case 2: return j < Y-1;
+            case 3: return j > 0;
+            case 4: return k < Z-1;
+            default: return k > 0;
+        }
+    };
+    const auto neighbor = [&L](const BandCell& c, const std::int32_t dir)
+    {
+        switch (dir)
+        {
+            case 0: return BandCell {L.neighbor<1, 0, 0>(c.n, c.i, c.j, c.k),
+                c.i+1, c.j, c.k};
+            case 1: return BandCell {L.neighbor<-1, 0, 0>(c.n, c.i, c.j, c.k),
+                c.i-1, c.j, c.k};
+            case 2: return BandCell {L.neighbor<0, 1, 0>(c.n, c.i, c.j, c.k),
+                c.i, c.j+1, c.k};
+            case 3: return BandCell {L.neighbor<0, -1, 0>(c.n, c.i, c.j, c.k),
+                c.i, c.j-1, c.k};
+            case 4: return BandCell {L.neighbor<0, 0, 1>(c.n, c.i, c.j, c.k),
+                c.i, c.j, c.k+1};
+            default: return BandCell {L.neighbor<0, 0, -1>(c.n, c.i, c.j, c.k),
+                c.i, c.j, c.k-1};
+        }
+    };
 
-            if (F.label(i, j, k) & LIQUID)
-            {
-                Ftemp(i, j, k) = F(i, j, k);
-                Ftemp.label(i, j, k) = LIQUID;
-            }
-            else if (F.label(i, j, k) & SOLID)
-            {
-                Ftemp(i, j, k) = F(i, j, k);
-                Ftemp.label(i, j, k) = SOLID;
-            }
-            else if (F.label(i, j, k) & EXTRAPOLATED)
-            {
-                Ftemp(i, j, k) = F(i, j, k);
-                Ftemp.label(i, j, k) = Ftemp.label(i, j, k) | EXTRAPOLATED;
-            }
-            else
+    // The EMPTY neighbors read by the cells of a list are gathered by each
+    // thread, then appended serially to the next layer if they are still
+    // EMPTY. They are marked by clearing their EMPTY bit, so they are
+    // neither read nor added twice
+    auto& layer = _layer;
+    auto& next = _layerNext;
+    auto& found = _layerFound;
+    const auto gather = [&](const BandCell& c, std::vector<BandCell>& out)
+    {
+        for (std::int32_t dir = 0; dir < 6; ++dir)
+        {
+            if (reads(c.i, c.j, c.k, dir))
             {
-                std::uint8_t nbNeighbors = 0;
-                double value = 0.0;
-                if (i < _grid._surface.x()-1 && F.checked(i+1, j, k))
+                const BandCell m = neighbor(c, dir);
+                if (F.label(m.n) == EMPTY)
                 {
-                    nbNeighbors++;
-                    value += F(i+1, j, k);
-                }
-                if (i > 0 && F.checked(i-1, j, k))
-                {
-                    nbNeighbors++;
-                    value += F(i-1, j, k);
+                    out.push_back(m);
                 }
-                if (j < _grid._surface.y()-1 && F.checked(i, j+1, k))
+            }
+        }
+    };
+    const auto mark = [&]()
+    {
+        next.clear();
+        for (auto& cells : found)
+        {
+            for (const BandCell& m : cells)
+            {
+                if (F.label(m.n) == EMPTY)
                 {
-                    nbNeighbors++;
-                    value += F(i, j+1, k);
+                    F.label(m.n) = static_cast<CellLabel>(0);
+                    next.push_back(m);
                 }
-                if (j > 0 && F.checked(i, j-1, k))
+            }
+            cells.clear();
+        }
+        layer.swap(next);
+    };
+
+    // First layer: the EMPTY cells read by a LIQUID cell. The values are
+    // only read on LIQUID and EXTRAPOLATED cells, the EMPTY ones are zeroed
+    // on the way
+    #pragma omp parallel
+    {
+        auto& out = found[omp_get_thread_num()];
+        #pragma omp for collapse(2)
+        for (std::int32_t k = 0; k < F.z(); ++k)
+        {
+            for (std::int32_t j = 0; j < F.y(); ++j)
+            {
+                for (std::int32_t i = 0; i < F.x(); ++i)
                 {
-                    nbNeighbors++;
-                    value += F(i, j-1, k);
+                    const std::uint64_t n = L(i, j, k);
+                    if (F.label(n) == LIQUID)
+                    {
+                        gather({n, i, j, k}, out);
+                    }
+                    else if (F.label(n) == EMPTY)
+                    {
+                        F(n) = 0.0;
+                    }
                 }
-                if (k < _grid._surface.z()-1 && F.checked(i, j, k+1))
+            }
+        }
+    }
+    mark();
+
+    auto& values = _layerValues;
+    for (std::uint32_t l = 1; !layer.empty(); ++l)
+    {
+        const std::int64_t nbCells = layer.size();
+        values.resize(nbCells);
+        #pragma omp parallel for
+        for (std::int64_t c = 0; c < nbCells; ++c)
+        {
+            std::uint8_t nbNeighbors = 0;
+            double value = 0.0;
+            for (std::int32_t dir = 0; dir < 6; ++dir)
+            {
+                if (!reads(layer[c].i, layer[c].j, layer[c].k, dir))
                 {
-                    nbNeighbors++;
-                    value += F(i, j, k+1);
+                    continue;
                 }
-                if (k > 0 && F.checked(i, j, k-1))
+                const std::uint64_t m = neighbor(layer[c], dir).n;
+                if (F.checked(m))
                 {
                     nbNeighbors++;
-                    value += F(i, j, k-1);
-                }
-                if (nbNeighbors > 0)
-                {
-                    nbNeg++;
-                    Ftemp(i, j, k) = value/nbNeighbors;
-                    Ftemp.label(i, j, k) = Ftemp.label(i, j, k) | EXTRAPOLATED;
+                    value += F(m);
                 }
             }
+            values[c] = value/nbNeighbors;
         }
-        F = Ftemp;
-        if (nbIte > 0 && ++it == nbIte)
+        #pragma omp parallel for
+        for (std::int64_t c = 0; c < nbCells; ++c)
         {
-            return;
+            F(layer[c].n) = values[c];
+            F.label(layer[c].n) = EXTRAPOLATED;
+        }
+        if (l == nbLayers)
+        {
+            break;
         }
-    } while (nbNeg > 0);
+        #pragma omp parallel
+        {
+            auto& out = found[omp_get_thread_num()];
+            #pragma omp for
+            for (std::int64_t c = 0; c < nbCells; ++c)
+            {
+                gather(layer[c], out);
+            }
+        }
+        mark();
+    }
 }
 
 // Try to force the gradient norm of the level-set to be equal to 1
+// in a band of Config::levelSetBand cells around the interface, either by
+// nbIte relaxation steps or by fast sweeping. The level-set is clamped to
+// the background value outside of the band. The tiles left at the
+// background value are then deactivated
 void Fluids::redistancing(
         const std::uint64_t nbIte,
-        Field<double, std::uint16_t>& field,
-        Field<double, std::uint16_t>& fieldTemp
-    ) const
+        SparseField<Real, std::uint16_t>& field
+    )
 {
     const double dx = 1.0/Config::N;
-    auto F = field;
-    auto QNew = field;
-    for (std::int16_t k = 0; k < field.z(); ++k)
+    const Real dist = field.background();
+    const auto& tiles = field.activeTiles();
+    const std::int64_t nbTiles = tiles.size();
+
+    // Distance to the interface in cells plus one, 0 outside of the band.
+    // Only the cells inside the grid are read, the scratch buffers are
+    // resized without being cleared
+    auto& band = _band;
+    band.resize(field.storage());
+    #pragma omp parallel for
+    for (std::int64_t t = 0; t < nbTiles; ++t)
+    {
+        field.forEachCell(tiles[t], [&](const std::int32_t i,
+                    const std::int32_t j, const std::int32_t k,
+                    const std::uint64_t n)
+        {
+            const bool inside = field(n) < 0;
+            band[n] =
+                (i+1 < field.x() && (field(i+1, j, k) < 0) != inside) ||
+                (i-1 >= 0 && (field(i-1, j, k) < 0) != inside) ||
+                (j+1 < field.y() && (field(i, j+1, k) < 0) != inside) ||
+                (j-1 >= 0 && (field(i, j-1, k) < 0) != inside) ||
+                (k+1 < field.z() && (field(i, j, k+1) < 0) != inside) ||
+                (k-1 >= 0 && (field(i, j, k-1) < 0) != inside);
+        });
+    }
+    if (Config::redistancing == FAST_SWEEPING)
+    {
+        fastSweeping(field);
+        field.prune();
+        return;
+    }
+
+    // Grow the band by one cell per pass
+    const auto inLayer = [&field, &band](
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k,
+            const std::uint8_t layer
+        )
     {
-        for (std::int16_t j = 0; j < field.y(); ++j)
+        const std::int64_t n = field.slot(i, j, k);
+        return n >= 0 && band[n] == layer;
+    };
+    auto& next = _bandNext;
+    next.resize(field.storage());
+    for (std::uint8_t layer = 1; layer <= dist; ++layer)
+    {
+        #pragma omp parallel for
+        for (std::int64_t t = 0; t < nbTiles; ++t)
         {
-            for (std::int16_t i = 0; i < field.x(); ++i)
+            field.forEachCell(tiles[t], [&](const std::int32_t i,
+                        const std::int32_t j, const std::int32_t k,
+                        const std::uint64_t n)
             {
-                if ((i+1 < field.x() &&
-                        !((field(i, j, k) >= 0) ^ (field(i+1, j, k) < 0))) ||
-                    (i-1 >= 0 &&
-                        !((field(i, j, k) >= 0) ^ (field(i-1, j, k) < 0))) ||
-                    (j+1 < field.y() &&
-                        !((field(i, j, k) >= 0) ^ (field(i, j+1, k) < 0))) ||
-                    (j-1 >= 0 &&
-                        !((field(i, j, k) >= 0) ^ (field(i, j-1, k) < 0))) ||
-                    (k+1 < field.z() &&
-                        !((field(i, j, k) >= 0) ^ (field(i, j, k+1) < 0))) ||
-                    (k-1 >= 0 &&
-                        !((field(i, j, k) >= 0) ^ (field(i, j, k-1) < 0))))
+                const bool grow = band[n] == 0 && (
+                        (i+1 < field.x() && inLayer(i+1, j, k, layer)) ||
+                        (i-1 >= 0 && inLayer(i-1, j, k, layer)) ||
+                        (j+1 < field.y() && inLayer(i, j+1, k, layer)) ||
+                        (j-1 >= 0 && inLayer(i, j-1, k, layer)) ||
+                        (k+1 < field.z() && inLayer(i, j, k+1, layer)) ||
+                        (k-1 >= 0 && inLayer(i, j, k-1, layer)));
+                next[n] = grow ? layer+1 : band[n];
+            });
+        }
+        band.swap(next);
+    }
+
+    // Clamp the level-set and init the smoothing function
+    auto& Ssf = _smoothing;
+    Ssf.resize(field.storage());
+    #pragma omp parallel for
+    for (std::int64_t t = 0; t < nbTiles; ++t)
+    {
+        field.forEachCell(tiles[t], [&](std::int32_t, std::int32_t,
+                    std::int32_t, const std::uint64_t n)
+        {
+            if (band[n] == 0 || std::abs(field(n)) > dist)
+            {
+                field(n) = dist * (field(n) <= 0 ? -1 : 1);
+            }
+            const double O0 = field(n);
+            Ssf[n] = O0 / (std::sqrt(std::pow(O0, 2) + std::pow(0.5, 2)));
+        });
+    }
+
+    // Step forward in fictious time
+    auto& n = _relaxed;
+    n.resize(field.storage());
+    for (std::uint64_t relaxit = 0; relaxit < nbIte; ++relaxit)
+    {
+        field.fillHalo();
+        #pragma omp parallel for
+        for (std::int64_t t = 0; t < nbTiles; ++t)
+        {
+            field.forEachCell(tiles[t], [&](const std::int32_t i,
+                        const std::int32_t j, const std::int32_t k,
+                        const std::uint64_t c)
+            {
+                if (band[c] > 0)
                 {
-                    F(i, j, k) = 1;
-                    F.label(i, j, k) = LIQUID;
+                    const double gO = field.gradLength(i, j, k);
+                    n[c] = (0.5 * dx * (- Ssf[c] * (gO - 1.0))) + field(c);
                 }
-                else
+            });
+        }
+        #pragma omp parallel for
+        for (std::int64_t t = 0; t < nbTiles; ++t)
+        {
+            field.forEachCell(tiles[t], [&](std::int32_t, std::int32_t,
+                        std::int32_t, const std::uint64_t c)
+            {
+                if (band[c] > 0)
                 {
-                    F(i, j, k) = 0;
-                    F.label(i, j, k) = EMPTY;
+                    field(c) = n[c];
                 }
-            }
+            });
         }
     }
+    field.prune();
+}
 
-    extrapolate(F, fieldTemp, 2);
+// Fast sweeping redistancing [Zhao 2005]. The cells next to the interface
+// get the distance to the crossings interpolated along the axes, then the
+// other cells of the active tiles solve |grad phi| = 1 by Gauss-Seidel
+// sweeps in the 2^dim diagonal orderings. Along a sweep the cells of the
+// plane i+j+k = constant (with the signs of the ordering) only depend on the
+// previous plane, so each plane is updated in parallel [Detrixhe 2013].
+// The distances are capped to the background value, which stands for the
+// unknown distance of the cells out of the band
+void Fluids::fastSweeping(SparseField<Real, std::uint16_t>& field)
+{
+    const double dist = field.background();
+    const std::int32_t X = field.x();
+    const std::int32_t Y = field.y();
+    const std::int32_t Z = field.z();
+    const auto& tiles = field.activeTiles();
+    const std::int64_t nbTiles = tiles.size();
+    const auto& band = _band;
 
-    std::uint8_t dist = 2;
-    for (std::uint16_t k = 0; k < field.z(); ++k)
+    // Distance of the interface cells, written aside since the crossings
+    // are interpolated from the values of their neighbors
+    auto& init = _relaxed;
+    init.resize(field.storage());
+    auto& crossed = _sweepTiles;
+    crossed.assign(nbTiles, 0);
+    #pragma omp parallel for
+    for (std::int64_t t = 0; t < nbTiles; ++t)
     {
-        for (std::uint16_t j = 0; j < field.y(); ++j)
+        field.forEachCell(tiles[t], [&](const std::int32_t i,
+                    const std::int32_t j, const std::int32_t k,
+                    const std::uint64_t n)
         {
-            for (std::uint16_t i = 0; i < field.x(); ++i)
+            const double c = field(n);
+            const double sign = c < 0 ? -1.0 : 1.0;
+            if (band[n] == 0)
+            {
+                init[n] = sign * dist;
+                return;
+            }
+            if (c == 0)
             {
-                if (F(i, j, k) == 0)
+                init[n] = 0;
+                crossed[field.block(n)] = 1;
+                return;
+            }
+            // 1/theta^2, theta being the fraction of cell to the closest
+            // crossing along the axis, 0 if the axis has no crossing
+            const auto inverseSquare = [c](const bool inPrev,
+                    const double prev, const bool inNext, const double next)
+            {
+                double theta = 2.0;
+                if (inPrev && (prev < 0) != (c < 0))
+                {
+                    theta = c/(c-prev);
+                }
+                if (inNext && (next < 0) != (c < 0))
                 {
-                    QNew(i, j, k) = dist * (field(i, j, k) <= 0 ? -1 : 1);
+                    theta = std::min(theta, c/(c-next));
                 }
+                return theta > 1.0 ? 0.0 : 1.0/(theta*theta);
+            };
+            double sum =
+                inverseSquare(i > 0, field(i-1, j, k),
+                        i+1 < X, field(i+1, j, k))
+                + inverseSquare(j > 0, field(i, j-1, k),
+                        j+1 < Y, field(i, j+1, k));
+            if (Z > 1)
+            {
+                sum += inverseSquare(k > 0, field(i, j, k-1),
+                        k+1 < Z, field(i, j, k+1));
             }
-        }
+            init[n] = sign / std::sqrt(sum);
+            crossed[field.block(n)] = 1;
+        });
     }
-    for (std::uint16_t k = 0; k < field.z(); ++k)
+
+    // The interface cells are kept, the other ones are swept. As the band
+    // is at most a tile wide, only the tiles next to a crossed tile can
+    // hold cells closer to the interface than the background value
+    auto& cells = _sweepCells;
+    cells.clear();
+    for (std::int64_t t = 0; t < nbTiles; ++t)
     {
-        for (std::uint16_t j = 0; j < field.y(); ++j)
+        bool near = false;
+        field.forEachNeighborTile(tiles[t], [&](const std::uint32_t block)
+        {
+            near |= crossed[block];
+        });
+        field.forEachCell(tiles[t], [&](const std::int32_t i,
+                    const std::int32_t j, const std::int32_t k,
+                    const std::uint64_t n)
         {
-            for (std::uint16_t i = 0; i < field.x(); ++i)
+            field(n) = init[n];
+            if (near && band[n] == 0)
             {
-                if (std::abs(QNew(i, j, k)) > dist)
-                {
-                    QNew(i, j, k) = dist * (field(i, j, k) <= 0 ? -1 : 1);
-                }
+                cells.push_back({n, i, j, k});
             }
-        }
+        });
     }
-    field = QNew;
-    Field<double, std::uint16_t> n = field;
-    Field<double, std::uint16_t> Ssf = field;
-    // Init smoothing function
-    for (std::uint16_t k = 0; k < field.z()-0; ++k)
+    const std::uint64_t nbCells = cells.size();
+
+    // Distance to the closest neighbor along an axis, the cells out of
+    // the grid are ignored
+    const auto closest = [dist](const bool inPrev, const double prev,
+            const bool inNext, const double next)
     {
-        for (std::uint16_t j = 0; j < field.y()-0; ++j)
+        double d = dist;
+        if (inPrev)
         {
-            for (std::uint16_t i = 0; i < field.x()-0; ++i)
+            d = std::min(d, std::abs(prev));
+        }
+        if (inNext)
+        {
+            d = std::min(d, std::abs(next));
+        }
+        return d;
+    };
+    // Upwind discretization of |grad phi| = 1, solved with the distances
+    // a <= b <= c of the closest neighbors along each axis
+    const auto update = [&](const BandCell& cell)
+    {
+        const std::uint64_t n = cell.n;
+        const std::int32_t i = cell.i;
+        const std::int32_t j = cell.j;
+        const std::int32_t k = cell.k;
+        const double x =
+            closest(i > 0, field.neighbor<-1, 0, 0>(n, i, j, k),
+                    i+1 < X, field.neighbor<1, 0, 0>(n, i, j, k));
+        const double y =
+            closest(j > 0, field.neighbor<0, -1, 0>(n, i, j, k),
+                    j+1 < Y, field.neighbor<0, 1, 0>(n, i, j, k));
+        const double z = Z == 1 ? dist :
+            closest(k > 0, field.neighbor<0, 0, -1>(n, i, j, k),
+                    k+1 < Z, field.neighbor<0, 0, 1>(n, i, j, k));
+        // The solution is at least a + 1/sqrt(3), most of the cells far
+        // from the interface are left at the background value
+        const double a = std::min({x, y, z});
+        Real& value = field(n);
+        if (a + 0.57735 >= std::abs(value))
+        {
+            return;
+        }
+        const double c = std::max({x, y, z});
+        const double b = x + y + z - a - c;
+        double u = a + 1.0;
+        if (u > b)
+        {
+            u = 0.5 * (a + b + std::sqrt(2.0 - (a-b)*(a-b)));
+            if (u > c)
             {
-                const double O0 = field(i, j, k);
-                Ssf(i, j, k) =
-                    O0 / (std::sqrt(std::pow(O0, 2) + std::pow(0.5, 2)));
+                const double s = a + b + c;
+                const double s2 = a*a + b*b + c*c;
+                u = (s + std::sqrt(s*s - 3.0*(s2 - 1.0))) / 3.0;
             }
         }
-    }
+        if (u < std::abs(value))
+        {
+            value = value < 0 ? -u : u;
+        }
+    };
 
-    // Step forward in fictious time
-    for (std::uint64_t relaxit = 0; relaxit < nbIte; ++relaxit)
+    // Each family of planes is swept forward then backward
+    const std::int32_t nbFamilies = Z > 1 ? 4 : 2;
+    const std::int32_t signs[4][3] =
+        {{1, 1, 1}, {1, -1, 1}, {1, 1, -1}, {-1, 1, 1}};
+    const std::int64_t nbPlanes = X + Y + Z - 2;
+    auto& order = _sweepOrder;
+    auto& planes = _sweepPlanes;
+    order.resize(nbCells);
+    for (std::int32_t f = 0; f < nbFamilies; ++f)
     {
-        for (std::uint16_t k = 0; k < field.z(); ++k)
+        const std::int32_t* s = signs[f];
+        const std::int64_t offset = (s[0] < 0 ? X-1 : 0)
+            + (s[1] < 0 ? Y-1 : 0) + (s[2] < 0 ? Z-1 : 0);
+        const auto plane = [s, offset](const BandCell& cell)
         {
-            for (std::uint16_t j = 0; j < field.y(); ++j)
+            return s[0]*cell.i + s[1]*cell.j + s[2]*cell.k + offset;
+        };
+        // Counting sort of the cells by plane
+        planes.assign(nbPlanes+1, 0);
+        for (const auto& cell : cells)
+        {
+            planes[plane(cell)+1]++;
+        }
+        for (std::int64_t p = 0; p < nbPlanes; ++p)
+        {
+            planes[p+1] += planes[p];
+        }
+        for (std::uint64_t c = 0; c < nbCells; ++c)
+        {
+            order[planes[plane(cells[c])]++] = c;
+        }
+        for (std::int64_t p = nbPlanes; p > 0; --p)
+        {
+            planes[p] = planes[p-1];
+        }
+        planes[0] = 0;
+
+        #pragma omp parallel
+        for (std::int64_t sweep = 0; sweep < 2*nbPlanes; ++sweep)
+        {
+            const std::int64_t p =
+                sweep < nbPlanes ? sweep : 2*nbPlanes-1 - sweep;
+            #pragma omp for schedule(static)
+            for (std::uint64_t o = planes[p]; o < planes[p+1]; ++o)
             {
-                for (std::uint16_t i = 0; i < field.x(); ++i)
-                {
-                    if (F(i, j, k) == 1)
-                    {
-                        const double gO = field.gradLength(i, j, k);
-                        n(i, j, k) =
-                            (0.5 * dx * (- Ssf(i, j, k) * (gO - 1.0))) +
-                            field(i, j, k);
-                    }
-                }
+                update(cells[order[o]]);
             }
         }
-        field = n;
     }
 }
 
+// Mean of ||grad phi| - 1| over the cells next to the interface
+// (|phi| < 1), the cells on the walls are left out as the halo is not
+// filled after the advection
+double Fluids::gradientDrift(
+        const SparseField<Real, std::uint16_t>& field
+    ) const
+{
+    const std::int32_t X = field.x();
+    const std::int32_t Y = field.y();
+    const std::int32_t Z = field.z();
+    const auto& tiles = field.activeTiles();
+    const std::int64_t nbTiles = tiles.size();
+    double drift = 0.0;
+    std::uint64_t nbCells = 0;
+    #pragma omp parallel for reduction(+:drift, nbCells)
+    for (std::int64_t t = 0; t < nbTiles; ++t)
+    {
+        field.forEachCell(tiles[t], [&](const std::int32_t i,
+                    const std::int32_t j, const std::int32_t k,
+                    const std::uint64_t n)
+        {
+            const bool wall = i == 0 || i == X-1 || j == 0 || j == Y-1
+                || (Z > 1 && (k == 0 || k == Z-1));
+            if (!wall && std::abs(field(n)) < 1.0)
+            {
+                drift += std::abs(field.gradLength(i, j, k) - 1.0);
+                nbCells++;
+            }
+        });
+    }
+    return nbCells > 0 ? drift/nbCells : 0.0;
+}
+
 // Export the level-set to a 3D texture
 void Fluids::updateTexture3D()
 {
@@ -386,15 +870,15 @@ void Fluids::updateTexture2D()
 }
 
 // Used to render velocity field in 2D
-const std::vector<double>& Fluids::X() const
+const Field<Real, std::uint16_t>& Fluids::X() const
 {
-    return _grid._U.data();
+    return _grid._U;
 }
 
 // Used to render velocity field in 2D
-const std::vector<double>& Fluids::Y() const
+const Field<Real, std::uint16_t>& Fluids::Y() const
 {
-    return _grid._V.data();
+    return _grid._V;
 }
 
 // Used to render velocity field in 2D
@@ -405,11 +889,37 @@ bool Fluids::isCellActive(
         const std::uint16_t k
     ) const
 {
+    // The velocity mesh also asks for the faces past the last cell
+    if (i >= _grid._pressureID.x() || j >= _grid._pressureID.y())
+    {
+        return false;
+    }
     return _grid._pressureID(i, j, k) > 0;
 }
 
+// Convergence and timings of the last pressure solve
+const SolverReport& Fluids::solverReport() const
+{
+    return _projection->report();
+}
+
+const RedistancingReport& Fluids::redistancingReport() const
+{
+    return _redistancingReport;
+}
+
+const TimeStepReport& Fluids::timeStepReport() const
+{
+    return _timeStepReport;
+}
+
+const AdvectionReport& Fluids::advectionReport() const
+{
+    return _advectionReport;
+}
+
 // Used to render velocity field in 2D
-const Field<double, std::uint16_t>& Fluids::surface() const
+const SparseField<Real, std::uint16_t>& Fluids::surface() const
 {
     return _grid._surface;
 }
@@ -6,6 +6,7 @@
 #include <execution>
 #include <vector>
 #include <memory>
+#include <fstream>
 
 #include "./types.h"
 #include "./config.h"
@@ -13,15 +14,54 @@
 #include "./Advect.h"
 #include "./Project.h"
 
+// Lazy redistancing of the level set: gradient drift measured after the
+// advection of the last step, and after the redistancing if it ran, with
+// the number of steps the redistancing ran and was skipped
+struct RedistancingReport
+{
+    double drift = 0.0;
+    double driftAfter = 0.0;
+    bool redistanced = false;
+    std::uint64_t nbRedistanced = 0;
+    std::uint64_t nbSkipped = 0;
+};
+
+// Time stepping of the last frame: simulated time, number of substeps,
+// time step of the last one and the maximum velocity it was chosen from
+struct TimeStepReport
+{
+    double time = 0.0;
+    double dt = 0.0;
+    double maxVelocity = 0.0;
+    std::uint32_t nbSubsteps = 0;
+};
+
+// Timings (in seconds) of the advections of the last step: level set,
+// each velocity component when they are advected one by one, and the
+// whole velocity, with the number of cells of the level set advected
+struct AdvectionReport
+{
+    double levelSetTime = 0.0;
+    std::uint64_t levelSetCells = 0;
+    double uTime = 0.0;
+    double vTime = 0.0;
+    double wTime = 0.0;
+    double velocityTime = 0.0;
+};
+
 class Fluids
 {
  public:
     explicit Fluids();
     void update(const std::uint64_t iteration);
     const std::vector<std::uint8_t>& texture() const;
-    const std::vector<double>& X() const;
-    const std::vector<double>& Y() const;
-    const Field<double, std::uint16_t>& surface() const;
+    const Field<Real, std::uint16_t>& X() const;
+    const Field<Real, std::uint16_t>& Y() const;
+    const SparseField<Real, std::uint16_t>& surface() const;
+    const SolverReport& solverReport() const;
+    const RedistancingReport& redistancingReport() const;
+    const TimeStepReport& timeStepReport() const;
+    const AdvectionReport& advectionReport() const;
     bool isCellActive(
             const std::uint16_t i,
             const std::uint16_t j,
@@ -29,26 +69,62 @@ class Fluids
         ) const;
 
  private:
-    void step();
-    void addForces();
+    double step(const double remaining);
+    double maxVelocity() const;
+    void addForces(const double dt);
     void redistancing(
             const std::uint64_t nbIte,
-            Field<double, std::uint16_t>& field,
-            Field<double, std::uint16_t>& fieldTemp
-        ) const;
+            SparseField<Real, std::uint16_t>& field
+        );
+    void fastSweeping(SparseField<Real, std::uint16_t>& field);
+    double gradientDrift(const SparseField<Real, std::uint16_t>& field) const;
     void extrapolate(
-            Field<double, std::uint16_t>& F,
-            Field<double, std::uint16_t>& Ftemp,
-            std::uint16_t nbIte = 0
-        ) const;
+            Field<Real, std::uint16_t>& F,
+            const std::uint16_t nbLayers
+        );
     void updateTexture2D();
     void updateTexture3D();
 
     std::uint64_t _iteration = 0;
+    std::uint64_t _nbSteps = 0;
+    std::uint64_t _lastRedistancing = 0;
+    RedistancingReport _redistancingReport;
+    TimeStepReport _timeStepReport;
+    AdvectionReport _advectionReport;
     std::vector<std::uint8_t> _texture;
-    StaggeredGrid<double, std::uint16_t> _grid {Config::N};
+    StaggeredGrid<Real, std::uint16_t> _grid
+        {Config::Nx, Config::Ny, Config::Nz};
+    // Scratch buffers of the redistancing, indexed like the blocks of the
+    // level set. They are kept between the steps, so they are only
+    // reallocated when the band grows past their capacity
+    std::vector<std::uint8_t> _band;
+    std::vector<std::uint8_t> _bandNext;
+    std::vector<Real> _smoothing;
+    std::vector<Real> _relaxed;
+    // Cell of a list, with its storage index
+    struct BandCell
+    {
+        std::uint64_t n;
+        std::int32_t i;
+        std::int32_t j;
+        std::int32_t k;
+    };
+    // Tiles of the fast sweeping holding interface cells (by block), the
+    // swept cells, and their order along the diagonal planes of a sweep
+    // with the offset of each plane in it
+    std::vector<std::uint8_t> _sweepTiles;
+    std::vector<BandCell> _sweepCells;
+    std::vector<std::uint32_t> _sweepOrder;
+    std::vector<std::uint64_t> _sweepPlanes;
+    // Layer of cells being extrapolated, the next one, their values, and
+    // the candidates of the next layer found by each thread
+    std::vector<BandCell> _layer;
+    std::vector<BandCell> _layerNext;
+    std::vector<Real> _layerValues;
+    std::vector<std::vector<BandCell>> _layerFound;
 
     std::unique_ptr<Advect> _advection;
     std::unique_ptr<Project> _projection;
+    std::ofstream _solverReport;
 };
 
@@ -0,0 +1,324 @@
+#include "Interpolation.h"
+
+#include <limits>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define INTERPOLATION_X86
+#include <immintrin.h>
+// The kernels must not contract their products and sums into FMA, which
+// GCC does by default where the target has them (avx512f implies fma)
+#if defined(__clang__)
+#define INTERPOLATION_TARGET(isa) __attribute__((target(isa)))
+#else
+#define INTERPOLATION_TARGET(isa) \
+    __attribute__((target(isa), optimize("fp-contract=off")))
+#endif
+#endif
+
+// Trilinear interpolation of one point in the storage F, same as
+// interpolate(F, x, y, z), for the points past the last full vector
+static inline double interpolatePoint(
+        const LinearStorage& F,
+        const double x,
+        const double y,
+        const double z
+    )
+{
+    const std::int32_t i0 = static_cast<std::int32_t>(x);
+    const std::int32_t i1 = std::clamp(i0 + 1, std::min(1, F.X-1), F.X-1);
+    const std::int32_t j0 = static_cast<std::int32_t>(y);
+    const std::int32_t j1 = std::clamp(j0 + 1, std::min(1, F.Y-1), F.Y-1);
+    const std::int32_t k0 = static_cast<std::int32_t>(z);
+    const std::int32_t k1 = std::clamp(k0 + 1, std::min(1, F.Z-1), F.Z-1);
+    const auto at = [&F](const std::int64_t i, const std::int64_t j,
+            const std::int64_t k)
+    {
+        return static_cast<double>(
+                F.data[F.origin + i + j*F.strideY + k*F.strideZ]);
+    };
+
+    const double s1 = x - i0;
+    const double s0 = 1.0 - s1;
+    const double t1 = y - j0;
+    const double t0 = 1.0 - t1;
+    const double u1 = z - k0;
+    const double u0 = 1.0 - u1;
+
+    return s0 * (     t0 * ( u0 * at(i0, j0, k0) + u1 * at(i0, j0, k1) )
+                    + t1 * ( u0 * at(i0, j1, k0) + u1 * at(i0, j1, k1) )
+                )
+         + s1 * (     t0 * ( u0 * at(i1, j0, k0) + u1 * at(i1, j0, k1) )
+                    + t1 * ( u0 * at(i1, j1, k0) + u1 * at(i1, j1, k1) )
+                );
+}
+
+#ifdef INTERPOLATION_X86
+
+// Gather of the values of the storage at the 64 bits indices idx, widened
+// to double in single precision
+INTERPOLATION_TARGET("avx2")
+static inline __m256d gather(const double* data, const __m256i idx)
+{
+    return _mm256_i64gather_pd(data, idx, 8);
+}
+INTERPOLATION_TARGET("avx2")
+static inline __m256d gather(const float* data, const __m256i idx)
+{
+    return _mm256_cvtps_pd(_mm256_i64gather_ps(data, idx, 4));
+}
+// The AVX-512 gathers and conversions are used in their masked forms with
+// a zero source: the plain ones of GCC start from an undefined vector,
+// which -Wmaybe-uninitialized reports
+INTERPOLATION_TARGET("avx512f")
+static inline __m512d gather(const double* data, const __m512i idx)
+{
+    return _mm512_mask_i64gather_pd(_mm512_setzero_pd(), 0xFF, idx, data, 8);
+}
+INTERPOLATION_TARGET("avx512f")
+static inline __m512d gather(const float* data, const __m512i idx)
+{
+    return _mm512_maskz_cvtps_pd(0xFF,
+            _mm512_mask_i64gather_ps(_mm256_setzero_ps(), 0xFF, idx, data, 4));
+}
+// Truncation to 32 bits integers
+INTERPOLATION_TARGET("avx512f")
+static inline __m256i truncate(const __m512d v)
+{
+    return _mm512_maskz_cvttpd_epi32(0xFF, v);
+}
+// Widening of 32 bits integers to 64 bits integers
+INTERPOLATION_TARGET("avx512f")
+static inline __m512i widen(const __m256i v)
+{
+    return _mm512_maskz_cvtepi32_epi64(0xFF, v);
+}
+// Conversion of 32 bits integers to double
+INTERPOLATION_TARGET("avx512f")
+static inline __m512d toDouble(const __m256i v)
+{
+    return _mm512_maskz_cvtepi32_pd(0xFF, v);
+}
+// Signed product of the low 32 bits of the 64 bits integers
+INTERPOLATION_TARGET("avx512f")
+static inline __m512i multiply(const __m512i a, const __m512i b)
+{
+    return _mm512_maskz_mul_epi32(0xFF, a, b);
+}
+
+// 4 points at a time: the corners are computed in 32 bits, their storage
+// indices in 64 bits and the 8 values gathered. The weights are applied
+// in the order of the scalar interpolation, without FMA, so both give the
+// same values
+INTERPOLATION_TARGET("avx2")
+static void interpolateAvx2(
+        const LinearStorage& F,
+        const std::uint32_t n,
+        const double* x,
+        const double* y,
+        const double* z,
+        double* values
+    )
+{
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i loX = _mm_set1_epi32(std::min(1, F.X-1));
+    const __m128i hiX = _mm_set1_epi32(F.X-1);
+    const __m128i loY = _mm_set1_epi32(std::min(1, F.Y-1));
+    const __m128i hiY = _mm_set1_epi32(F.Y-1);
+    const __m128i loZ = _mm_set1_epi32(std::min(1, F.Z-1));
+    const __m128i hiZ = _mm_set1_epi32(F.Z-1);
+    const __m256i origin = _mm256_set1_epi64x(F.origin);
+    const __m256i strideY = _mm256_set1_epi64x(F.strideY);
+    const __m256i strideZ = _mm256_set1_epi64x(F.strideZ);
+    const __m256d ones = _mm256_set1_pd(1.0);
+
+    std::uint32_t p = 0;
+    for (; p + 4 <= n; p += 4)
+    {
+        const __m256d px = _mm256_loadu_pd(x + p);
+        const __m256d py = _mm256_loadu_pd(y + p);
+        const __m256d pz = _mm256_loadu_pd(z + p);
+        const __m128i i0 = _mm256_cvttpd_epi32(px);
+        const __m128i j0 = _mm256_cvttpd_epi32(py);
+        const __m128i k0 = _mm256_cvttpd_epi32(pz);
+        const __m128i i1 = _mm_min_epi32(
+                _mm_max_epi32(_mm_add_epi32(i0, one), loX), hiX);
+        const __m128i j1 = _mm_min_epi32(
+                _mm_max_epi32(_mm_add_epi32(j0, one), loY), hiY);
+        const __m128i k1 = _mm_min_epi32(
+                _mm_max_epi32(_mm_add_epi32(k0, one), loZ), hiZ);
+
+        const __m256d s1 = _mm256_sub_pd(px, _mm256_cvtepi32_pd(i0));
+        const __m256d s0 = _mm256_sub_pd(ones, s1);
+        const __m256d t1 = _mm256_sub_pd(py, _mm256_cvtepi32_pd(j0));
+        const __m256d t0 = _mm256_sub_pd(ones, t1);
+        const __m256d u1 = _mm256_sub_pd(pz, _mm256_cvtepi32_pd(k0));
+        const __m256d u0 = _mm256_sub_pd(ones, u1);
+
+        const __m256i I0 = _mm256_add_epi64(origin, _mm256_cvtepi32_epi64(i0));
+        const __m256i I1 = _mm256_add_epi64(origin, _mm256_cvtepi32_epi64(i1));
+        const __m256i J0 = _mm256_mul_epi32(_mm256_cvtepi32_epi64(j0), strideY);
+        const __m256i J1 = _mm256_mul_epi32(_mm256_cvtepi32_epi64(j1), strideY);
+        const __m256i K0 = _mm256_mul_epi32(_mm256_cvtepi32_epi64(k0), strideZ);
+        const __m256i K1 = _mm256_mul_epi32(_mm256_cvtepi32_epi64(k1), strideZ);
+        // Interpolation along k of the corners (I,J) of the cells
+        const __m256i J0K0 = _mm256_add_epi64(J0, K0);
+        const __m256i J0K1 = _mm256_add_epi64(J0, K1);
+        const __m256i J1K0 = _mm256_add_epi64(J1, K0);
+        const __m256i J1K1 = _mm256_add_epi64(J1, K1);
+        const __m256d c00 = _mm256_add_pd(
+                _mm256_mul_pd(u0, gather(F.data, _mm256_add_epi64(I0, J0K0))),
+                _mm256_mul_pd(u1, gather(F.data, _mm256_add_epi64(I0, J0K1))));
+        const __m256d c01 = _mm256_add_pd(
+                _mm256_mul_pd(u0, gather(F.data, _mm256_add_epi64(I0, J1K0))),
+                _mm256_mul_pd(u1, gather(F.data, _mm256_add_epi64(I0, J1K1))));
+        const __m256d c10 = _mm256_add_pd(
+                _mm256_mul_pd(u0, gather(F.data, _mm256_add_epi64(I1, J0K0))),
+                _mm256_mul_pd(u1, gather(F.data, _mm256_add_epi64(I1, J0K1))));
+        const __m256d c11 = _mm256_add_pd(
+                _mm256_mul_pd(u0, gather(F.data, _mm256_add_epi64(I1, J1K0))),
+                _mm256_mul_pd(u1, gather(F.data, _mm256_add_epi64(I1, J1K1))));
+        const __m256d c0 = _mm256_add_pd(_mm256_mul_pd(t0, c00),
+                _mm256_mul_pd(t1, c01));
+        const __m256d c1 = _mm256_add_pd(_mm256_mul_pd(t0, c10),
+                _mm256_mul_pd(t1, c11));
+        _mm256_storeu_pd(values + p, _mm256_add_pd(_mm256_mul_pd(s0, c0),
+                    _mm256_mul_pd(s1, c1)));
+    }
+    for (; p < n; ++p)
+    {
+        values[p] = interpolatePoint(F, x[p], y[p], z[p]);
+    }
+}
+
+// 8 points at a time, as with AVX2
+INTERPOLATION_TARGET("avx512f")
+static void interpolateAvx512(
+        const LinearStorage& F,
+        const std::uint32_t n,
+        const double* x,
+        const double* y,
+        const double* z,
+        double* values
+    )
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i loX = _mm256_set1_epi32(std::min(1, F.X-1));
+    const __m256i hiX = _mm256_set1_epi32(F.X-1);
+    const __m256i loY = _mm256_set1_epi32(std::min(1, F.Y-1));
+    const __m256i hiY = _mm256_set1_epi32(F.Y-1);
+    const __m256i loZ = _mm256_set1_epi32(std::min(1, F.Z-1));
+    const __m256i hiZ = _mm256_set1_epi32(F.Z-1);
+    const __m512i origin = _mm512_set1_epi64(F.origin);
+    const __m512i strideY = _mm512_set1_epi64(F.strideY);
+    const __m512i strideZ = _mm512_set1_epi64(F.strideZ);
+    const __m512d ones = _mm512_set1_pd(1.0);
+
+    std::uint32_t p = 0;
+    for (; p + 8 <= n; p += 8)
+    {
+        const __m512d px = _mm512_loadu_pd(x + p);
+        const __m512d py = _mm512_loadu_pd(y + p);
+        const __m512d pz = _mm512_loadu_pd(z + p);
+        const __m256i i0 = truncate(px);
+        const __m256i j0 = truncate(py);
+        const __m256i k0 = truncate(pz);
+        const __m256i i1 = _mm256_min_epi32(
+                _mm256_max_epi32(_mm256_add_epi32(i0, one), loX), hiX);
+        const __m256i j1 = _mm256_min_epi32(
+                _mm256_max_epi32(_mm256_add_epi32(j0, one), loY), hiY);
+        const __m256i k1 = _mm256_min_epi32(
+                _mm256_max_epi32(_mm256_add_epi32(k0, one), loZ), hiZ);
+
+        const __m512d s1 = _mm512_sub_pd(px, toDouble(i0));
+        const __m512d s0 = _mm512_sub_pd(ones, s1);
+        const __m512d t1 = _mm512_sub_pd(py, toDouble(j0));
+        const __m512d t0 = _mm512_sub_pd(ones, t1);
+        const __m512d u1 = _mm512_sub_pd(pz, toDouble(k0));
+        const __m512d u0 = _mm512_sub_pd(ones, u1);
+
+        const __m512i I0 = _mm512_add_epi64(origin, widen(i0));
+        const __m512i I1 = _mm512_add_epi64(origin, widen(i1));
+        const __m512i J0 = multiply(widen(j0), strideY);
+        const __m512i J1 = multiply(widen(j1), strideY);
+        const __m512i K0 = multiply(widen(k0), strideZ);
+        const __m512i K1 = multiply(widen(k1), strideZ);
+        // Interpolation along k of the corners (I,J) of the cells
+        const __m512i J0K0 = _mm512_add_epi64(J0, K0);
+        const __m512i J0K1 = _mm512_add_epi64(J0, K1);
+        const __m512i J1K0 = _mm512_add_epi64(J1, K0);
+        const __m512i J1K1 = _mm512_add_epi64(J1, K1);
+        const __m512d c00 = _mm512_add_pd(
+                _mm512_mul_pd(u0, gather(F.data, _mm512_add_epi64(I0, J0K0))),
+                _mm512_mul_pd(u1, gather(F.data, _mm512_add_epi64(I0, J0K1))));
+        const __m512d c01 = _mm512_add_pd(
+                _mm512_mul_pd(u0, gather(F.data, _mm512_add_epi64(I0, J1K0))),
+                _mm512_mul_pd(u1, gather(F.data, _mm512_add_epi64(I0, J1K1))));
+        const __m512d c10 = _mm512_add_pd(
+                _mm512_mul_pd(u0, gather(F.data, _mm512_add_epi64(I1, J0K0))),
+                _mm512_mul_pd(u1, gather(F.data, _mm512_add_epi64(I1, J0K1))));
+        const __m512d c11 = _mm512_add_pd(
+                _mm512_mul_pd(u0, gather(F.data, _mm512_add_epi64(I1, J1K0))),
+                _mm512_mul_pd(u1, gather(F.data, _mm512_add_epi64(I1, J1K1))));
+        const __m512d c0 = _mm512_add_pd(_mm512_mul_pd(t0, c00),
+                _mm512_mul_pd(t1, c01));
+        const __m512d c1 = _mm512_add_pd(_mm512_mul_pd(t0, c10),
+                _mm512_mul_pd(t1, c11));
+        _mm512_storeu_pd(values + p, _mm512_add_pd(_mm512_mul_pd(s0, c0),
+                    _mm512_mul_pd(s1, c1)));
+    }
+    for (; p < n; ++p)
+    {
+        values[p] = interpolatePoint(F, x[p], y[p], z[p]);
+    }
+}
+
+#endif
+
+InstructionSet interpolationInstructionSet()
+{
+#ifdef INTERPOLATION_X86
+    static const bool avx512 = __builtin_cpu_supports("avx512f");
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (Config::instructionSet >= AVX512 && avx512)
+    {
+        return AVX512;
+    }
+    if (Config::instructionSet >= AVX2 && avx2)
+    {
+        return AVX2;
+    }
+#endif
+    return SCALAR;
+}
+
+bool interpolateLinear(
+        const LinearStorage& F,
+        const std::uint32_t n,
+        const double* x,
+        const double* y,
+        const double* z,
+        double* values
+    )
+{
+#ifdef INTERPOLATION_X86
+    // The rows and slices are multiplied in 32 bits
+    constexpr std::int64_t max = std::numeric_limits<std::int32_t>::max();
+    if (F.strideY > max || F.strideZ > max)
+    {
+        return false;
+    }
+    switch (interpolationInstructionSet())
+    {
+        case AVX512:
+            interpolateAvx512(F, n, x, y, z, values);
+            return true;
+        case AVX2:
+            interpolateAvx2(F, n, x, y, z, values);
+            return true;
+        default:
+            return false;
+    }
+#else
+    return false;
+#endif
+}
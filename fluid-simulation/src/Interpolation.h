@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+#include "./types.h"
+#include "./config.h"
+#include "./Layout.h"
+#include "./StaggeredGrid.h"
+
+// Trilinear interpolation in the field F at (x,y,z), in cell coordinates
+// within [0; size] along each axis. The upper corner is clamped to
+// [1; size-1], and to 0 along k in 2D where z is 0
+template<typename Grid>
+inline double interpolate(
+        const Grid& F,
+        const double x,
+        const double y,
+        const double z
+    )
+{
+    const std::int32_t X = F.x();
+    const std::int32_t Y = F.y();
+    const std::int32_t Z = F.z();
+    const std::int32_t i0 = static_cast<std::int32_t>(x);
+    const std::int32_t i1 = std::clamp(i0 + 1, std::min(1, X-1), X-1);
+    const std::int32_t j0 = static_cast<std::int32_t>(y);
+    const std::int32_t j1 = std::clamp(j0 + 1, std::min(1, Y-1), Y-1);
+    const std::int32_t k0 = static_cast<std::int32_t>(z);
+    const std::int32_t k1 = std::clamp(k0 + 1, std::min(1, Z-1), Z-1);
+
+    const double s1 = x - i0;
+    const double s0 = 1.0 - s1;
+    const double t1 = y - j0;
+    const double t0 = 1.0 - t1;
+    const double u1 = z - k0;
+    const double u0 = 1.0 - u1;
+
+    return s0 * (     t0 * ( u0 * F(i0, j0, k0) + u1 * F(i0, j0, k1) )
+                    + t1 * ( u0 * F(i0, j1, k0) + u1 * F(i0, j1, k1) )
+                )
+         + s1 * (     t0 * ( u0 * F(i1, j0, k0) + u1 * F(i1, j0, k1) )
+                    + t1 * ( u0 * F(i1, j1, k0) + u1 * F(i1, j1, k1) )
+                );
+}
+
+// Storage of a Field with the LinearLayout, as seen by the vectorized
+// interpolation: index of (i,j,k) = origin + i + j*strideY + k*strideZ
+struct LinearStorage
+{
+    const Real* data;
+    std::int64_t origin;
+    std::int64_t strideY;
+    std::int64_t strideZ;
+    std::int32_t X;
+    std::int32_t Y;
+    std::int32_t Z;
+};
+
+// Interpolate the n points with the vectorized kernel of the widest
+// instruction set both allowed by Config::instructionSet and supported by
+// the CPU. Returns false, without interpolating, if there is none
+bool interpolateLinear(
+        const LinearStorage& F,
+        const std::uint32_t n,
+        const double* x,
+        const double* y,
+        const double* z,
+        double* values
+    );
+// Instruction set used by the batched interpolation of the Fields with the
+// LinearLayout
+InstructionSet interpolationInstructionSet();
+
+template<typename Grid>
+struct IsLinearField : std::false_type {};
+template<typename U>
+struct IsLinearField<Field<Real, U, LinearLayout>> : std::true_type {};
+
+// Interpolate the field F at the n points (x[p],y[p],z[p]) into values[p],
+// a row of backtraced points at a time. The Fields of Real with the
+// LinearLayout gather the corners of several points at once with AVX2 or
+// AVX-512, the other grids (bricks, sparse level set) loop over the points
+template<typename Grid>
+inline void interpolate(
+        const Grid& F,
+        const std::uint32_t n,
+        const double* x,
+        const double* y,
+        const double* z,
+        double* values
+    )
+{
+    if constexpr (IsLinearField<Grid>::value)
+    {
+        const auto& L = F.layout();
+        const std::int64_t origin = L(0, 0, 0);
+        const LinearStorage storage {F.data().data(), origin,
+            static_cast<std::int64_t>(L(0, 1, 0)) - origin,
+            static_cast<std::int64_t>(L(0, 0, F.z() > 1 ? 1 : 0)) - origin,
+            F.x(), F.y(), F.z()};
+        if (interpolateLinear(storage, n, x, y, z, values))
+        {
+            return;
+        }
+    }
+    for (std::uint32_t p = 0; p < n; ++p)
+    {
+        values[p] = interpolate(F, x[p], y[p], z[p]);
+    }
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Storage layouts of a Field, mapping the cell (i,j,k) of a X*Y*Z grid
+// to its index in the flat storage of the field.
+// The storage is surrounded by "halo" ghost cells on each side, so the
+// coordinates go from -halo to X+halo-1. There is no halo along k in 2D
+
+// Row-major storage: idx = i + j*X + k*X*Y, shifted by the halo
+class LinearLayout
+{
+ public:
+    LinearLayout(
+            const std::uint64_t X,
+            const std::uint64_t Y,
+            const std::uint64_t Z,
+            const std::uint8_t halo
+        )
+        : _X(X + 2*halo)
+        , _XY(_X * (Y + 2*halo))
+    {
+        const std::uint8_t haloZ = Z == 1 ? 0 : halo;
+        _size = _XY * (Z + 2*haloZ);
+        _origin = halo + halo * _X + haloZ * _XY;
+    }
+
+    inline std::uint64_t operator()(
+            const std::int64_t i,
+            const std::int64_t j,
+            const std::int64_t k
+        ) const
+    {
+        return _origin + i + j * _X + k * _XY;
+    }
+    // Index of the cell (i+di, j+dj, k+dk), knowing the index n of (i,j,k)
+    template<std::int8_t di, std::int8_t dj, std::int8_t dk>
+    inline std::uint64_t neighbor(
+            const std::uint64_t n,
+            const std::int64_t,
+            const std::int64_t,
+            const std::int64_t
+        ) const
+    {
+        return n + di + dj * _X + dk * _XY;
+    }
+    inline std::uint64_t size() const
+    {
+        return _size;
+    }
+
+ private:
+    std::int64_t _X;
+    std::int64_t _XY;
+    std::int64_t _origin;
+    std::uint64_t _size;
+};
+
+// Storage by bricks of 2^log2B cells along each axis (one cell deep in 2D),
+// so that the k-1 and k+1 neighbors of a cell are usually in the same few
+// cache lines and pages. The bricks are stored in row-major order and the
+// cells of a brick either in Morton (Z-curve) or in row-major order.
+// Grids that are not a multiple of the brick size are padded
+template<std::uint8_t log2B = 3, bool morton = true>
+class BrickLayout
+{
+ public:
+    BrickLayout(
+            const std::uint64_t X,
+            const std::uint64_t Y,
+            const std::uint64_t Z,
+            const std::uint8_t halo
+        )
+        : _halo(halo)
+        , _haloZ(Z == 1 ? 0 : halo)
+    {
+        const std::uint64_t depth = Z == 1 ? 1 : _B;
+        const std::uint8_t nbAxis = Z == 1 ? 2 : 3;
+        const std::uint64_t bricksX = (X+2*_halo+_B-1) >> log2B;
+        const std::uint64_t bricksY = (Y+2*_halo+_B-1) >> log2B;
+        const std::uint64_t bricksZ = (Z+2*_haloZ+depth-1) / depth;
+        _strideX = _B * _B * depth;
+        _strideY = _strideX * bricksX;
+        _strideZ = _strideY * bricksY;
+        _size = _strideZ * bricksZ;
+        for (std::uint64_t c = 0; c < _B; ++c)
+        {
+            if (morton)
+            {
+                // Spread the bits of c, nbAxis apart
+                std::uint32_t spread = 0;
+                for (std::uint8_t bit = 0; bit < log2B; ++bit)
+                {
+                    spread |= ((c >> bit) & 1) << (bit * nbAxis);
+                }
+                _offsetX[c] = spread;
+                _offsetY[c] = spread << 1;
+                _offsetZ[c] = Z > 1 ? spread << 2 : 0;
+            }
+            else
+            {
+                _offsetX[c] = c;
+                _offsetY[c] = c * _B;
+                _offsetZ[c] = Z > 1 ? c * _B * _B : 0;
+            }
+        }
+    }
+
+    inline std::uint64_t operator()(
+            const std::int64_t i,
+            const std::int64_t j,
+            const std::int64_t k
+        ) const
+    {
+        const std::uint64_t x = i + _halo;
+        const std::uint64_t y = j + _halo;
+        const std::uint64_t z = k + _haloZ;
+        return (x >> log2B) * _strideX + _offsetX[x & _mask]
+            + (y >> log2B) * _strideY + _offsetY[y & _mask]
+            + (z >> log2B) * _strideZ + _offsetZ[z & _mask];
+    }
+    template<std::int8_t di, std::int8_t dj, std::int8_t dk>
+    inline std::uint64_t neighbor(
+            const std::uint64_t,
+            const std::int64_t i,
+            const std::int64_t j,
+            const std::int64_t k
+        ) const
+    {
+        return operator()(i + di, j + dj, k + dk);
+    }
+    inline std::uint64_t size() const
+    {
+        return _size;
+    }
+
+ private:
+    constexpr static std::uint64_t _B = 1 << log2B;
+    constexpr static std::uint64_t _mask = _B - 1;
+
+    std::uint64_t _halo;
+    std::uint64_t _haloZ;
+    std::uint64_t _strideX;
+    std::uint64_t _strideY;
+    std::uint64_t _strideZ;
+    std::uint64_t _size;
+    std::array<std::uint32_t, _B> _offsetX;
+    std::array<std::uint32_t, _B> _offsetY;
+    std::array<std::uint32_t, _B> _offsetZ;
+};
+
+// Layout of every Field of the simulation, chosen at build time
+#ifdef BRICK_LAYOUT
+using DefaultLayout = BrickLayout<3, true>;
+#else
+using DefaultLayout = LinearLayout;
+#endif
@@ -7,24 +7,27 @@
 
 #include "./glm/gtx/string_cast.hpp"
 #include "./StaggeredGrid.h"
+#include "./Interpolation.h"
 
 class MarchingCube
 {
  public:
     void run(
-            const Field<double, std::uint16_t>& F,
+            const SparseField<Real, std::uint16_t>& F,
             const std::uint64_t iteration
         );
 
  private:
-    inline double interp(
-            const Field<double, std::uint16_t>& F,
-            const double x,
-            const double y,
-            const double z
+    inline void interp(
+            const SparseField<Real, std::uint16_t>& F,
+            const std::uint32_t n,
+            double* x,
+            double* y,
+            double* z,
+            double* values
         ) const;
     inline glm::vec3 computeNormal(
-            const Field<double, std::uint16_t>& F,
+            const SparseField<Real, std::uint16_t>& F,
             const glm::vec3 p
         ) const;
     inline bool check(
@@ -32,7 +35,7 @@ class MarchingCube
             const glm::vec3 &right
         ) const;
     std::uint16_t getCubeIndex(
-            const Field<double, std::uint16_t>& F,
+            const SparseField<Real, std::uint16_t>& F,
             const double x,
             const double y,
             const double z
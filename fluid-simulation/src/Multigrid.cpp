@@ -0,0 +1,308 @@
+#include "Multigrid.h"
+
+// Build the grid hierarchy from the liquid cells tagged by "tagActiveCells",
+// a coarse cell is liquid if any of its children is liquid
+void Multigrid::build(const StaggeredGrid<Real, std::uint16_t>& grid)
+{
+    if (_levels.empty()
+            || _levels[0].x != grid._surface.x()
+            || _levels[0].y != grid._surface.y()
+            || _levels[0].z != grid._surface.z())
+    {
+        _levels.clear();
+        std::uint16_t x = grid._surface.x();
+        std::uint16_t y = grid._surface.y();
+        std::uint16_t z = grid._surface.z();
+        while (true)
+        {
+            Level level;
+            level.x = x;
+            level.y = y;
+            level.z = z;
+            const std::uint64_t size = static_cast<std::uint64_t>(x)*y*z;
+            level.active.resize(size, 0);
+            level.u.resize(size, 0.0);
+            level.b.resize(size, 0.0);
+            level.r.resize(size, 0.0);
+            _levels.push_back(std::move(level));
+            if (std::max({x, y, z}) <= _coarsestSize)
+            {
+                break;
+            }
+            x = (x+1)/2;
+            y = (y+1)/2;
+            z = (z+1)/2;
+        }
+    }
+
+    Level& finest = _levels[0];
+    const auto& cells = grid.activeList();
+    const std::int64_t size = cells.size();
+    std::fill(finest.active.begin(), finest.active.end(), 0);
+    #pragma omp parallel for
+    for (std::int64_t c = 0; c < size; ++c)
+    {
+        finest.active[finest.idx(cells[c].i, cells[c].j, cells[c].k)] = 1;
+    }
+
+    for (std::uint64_t l = 1; l < _levels.size(); ++l)
+    {
+        const Level& fine = _levels[l-1];
+        Level& coarse = _levels[l];
+        #pragma omp parallel for collapse(2)
+        for (std::int32_t k = 0; k < coarse.z; ++k)
+        {
+            for (std::int32_t j = 0; j < coarse.y; ++j)
+            {
+                for (std::int32_t i = 0; i < coarse.x; ++i)
+                {
+                    std::uint8_t active = 0;
+                    for (std::int32_t kk = 2*k;
+                            kk < std::min(2*k+2, static_cast<int>(fine.z));
+                            ++kk)
+                    {
+                        for (std::int32_t jj = 2*j;
+                                jj < std::min(2*j+2, static_cast<int>(fine.y));
+                                ++jj)
+                        {
+                            for (std::int32_t ii = 2*i;
+                                    ii < std::min(2*i+2,
+                                        static_cast<int>(fine.x));
+                                    ++ii)
+                            {
+                                active |= fine.active[fine.idx(ii, jj, kk)];
+                            }
+                        }
+                    }
+                    coarse.active[coarse.idx(i, j, k)] = active;
+                }
+            }
+        }
+    }
+}
+
+// Apply one V-cycle to the residual r, the result is stored in z
+void Multigrid::apply(
+        const Eigen::Ref<const Eigen::VectorXd>& r,
+        Eigen::Ref<Eigen::VectorXd> z,
+        const StaggeredGrid<Real, std::uint16_t>& grid
+    )
+{
+    Level& finest = _levels[0];
+    const auto& cells = grid.activeList();
+    const std::int64_t size = cells.size();
+    std::fill(finest.b.begin(), finest.b.end(), 0.0);
+    #pragma omp parallel for
+    for (std::int64_t c = 0; c < size; ++c)
+    {
+        finest.b[finest.idx(cells[c].i, cells[c].j, cells[c].k)] = r.coeff(c);
+    }
+
+    vCycle(0);
+
+    #pragma omp parallel for
+    for (std::int64_t c = 0; c < size; ++c)
+    {
+        z.coeffRef(c) =
+            finest.u[finest.idx(cells[c].i, cells[c].j, cells[c].k)];
+    }
+}
+
+// Recursive V-cycle starting from a zero guess, with the same number of
+// pre and post smoothing steps to keep the preconditioner symmetric
+void Multigrid::vCycle(const std::uint64_t l)
+{
+    Level& level = _levels[l];
+    std::fill(level.u.begin(), level.u.end(), 0.0);
+    if (l+1 == _levels.size())
+    {
+        smooth(level, _coarsestIte);
+        return;
+    }
+    smooth(level, _smoothingIte);
+    residual(level);
+    restriction(level, _levels[l+1]);
+    vCycle(l+1);
+    prolongation(_levels[l+1], level);
+    smooth(level, _smoothingIte);
+}
+
+// Damped Jacobi smoothing of the level, nbIte times
+void Multigrid::smooth(Level& level, const std::uint16_t nbIte) const
+{
+    for (std::uint16_t it = 0; it < nbIte; ++it)
+    {
+        residual(level);
+        #pragma omp parallel for collapse(2)
+        for (std::int32_t k = 0; k < level.z; ++k)
+        {
+            for (std::int32_t j = 0; j < level.y; ++j)
+            {
+                for (std::int32_t i = 0; i < level.x; ++i)
+                {
+                    const std::uint64_t n = level.idx(i, j, k);
+                    if (level.active[n])
+                    {
+                        level.u[n] += _omega * level.r[n] /
+                            level.nonSolidNeighbors(i, j, k);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Compute r = b - Au on the liquid cells of the level,
+// air cells are Dirichlet (p = 0) and domain walls are Neumann
+void Multigrid::residual(Level& level) const
+{
+    const std::uint64_t X = level.x;
+    const std::uint64_t XY = X*level.y;
+    #pragma omp parallel for collapse(2)
+    for (std::int32_t k = 0; k < level.z; ++k)
+    {
+        for (std::int32_t j = 0; j < level.y; ++j)
+        {
+            for (std::int32_t i = 0; i < level.x; ++i)
+            {
+                const std::uint64_t n = level.idx(i, j, k);
+                if (!level.active[n])
+                {
+                    level.r[n] = 0.0;
+                    continue;
+                }
+                double Au = level.nonSolidNeighbors(i, j, k) * level.u[n];
+                if (i > 0 && level.active[n-1])
+                    Au -= level.u[n-1];
+                if (i+1 < level.x && level.active[n+1])
+                    Au -= level.u[n+1];
+                if (j > 0 && level.active[n-X])
+                    Au -= level.u[n-X];
+                if (j+1 < level.y && level.active[n+X])
+                    Au -= level.u[n+X];
+                if (k > 0 && level.active[n-XY])
+                    Au -= level.u[n-XY];
+                if (k+1 < level.z && level.active[n+XY])
+                    Au -= level.u[n+XY];
+                level.r[n] = level.b[n] - Au;
+            }
+        }
+    }
+}
+
+// Linear interpolation weight of the coarse cell c for the fine cell i
+// along one axis, cells past the walls are clamped to the border cell
+inline double Multigrid::weight(
+        const std::int32_t i,
+        const std::int32_t c,
+        const std::uint16_t nc
+    ) const
+{
+    const std::int32_t parent = i/2;
+    const std::int32_t other =
+        std::clamp(i % 2 == 0 ? parent-1 : parent+1, 0, nc-1);
+    double w = 0.0;
+    if (c == parent)
+        w += 0.75;
+    if (c == other)
+        w += 0.25;
+    return w;
+}
+
+// Restrict the fine residual to the coarse right-hand side, using the
+// transpose of the prolongation scaled by the (2h/h)^2 operator ratio
+void Multigrid::restriction(const Level& fine, Level& coarse) const
+{
+    const double scale = 4.0 / (
+            (fine.x > 1 ? 2.0 : 1.0) *
+            (fine.y > 1 ? 2.0 : 1.0) *
+            (fine.z > 1 ? 2.0 : 1.0)
+        );
+    #pragma omp parallel for collapse(2)
+    for (std::int32_t k = 0; k < coarse.z; ++k)
+    {
+        for (std::int32_t j = 0; j < coarse.y; ++j)
+        {
+            for (std::int32_t i = 0; i < coarse.x; ++i)
+            {
+                const std::uint64_t n = coarse.idx(i, j, k);
+                if (!coarse.active[n])
+                {
+                    coarse.b[n] = 0.0;
+                    continue;
+                }
+                double sum = 0.0;
+                for (std::int32_t kk = std::max(2*k-2, 0);
+                        kk < std::min(2*k+4, static_cast<int>(fine.z));
+                        ++kk)
+                {
+                    const double wk = weight(kk, k, coarse.z);
+                    if (wk == 0.0)
+                        continue;
+                    for (std::int32_t jj = std::max(2*j-2, 0);
+                            jj < std::min(2*j+4, static_cast<int>(fine.y));
+                            ++jj)
+                    {
+                        const double wj = weight(jj, j, coarse.y);
+                        if (wj == 0.0)
+                            continue;
+                        for (std::int32_t ii = std::max(2*i-2, 0);
+                                ii < std::min(2*i+4, static_cast<int>(fine.x));
+                                ++ii)
+                        {
+                            sum += wk * wj * weight(ii, i, coarse.x) *
+                                fine.r[fine.idx(ii, jj, kk)];
+                        }
+                    }
+                }
+                coarse.b[n] = scale * sum;
+            }
+        }
+    }
+}
+
+// Add the trilinear interpolation of the coarse correction
+// to the liquid cells of the fine level
+void Multigrid::prolongation(const Level& coarse, Level& fine) const
+{
+    #pragma omp parallel for collapse(2)
+    for (std::int32_t k = 0; k < fine.z; ++k)
+    {
+        for (std::int32_t j = 0; j < fine.y; ++j)
+        {
+            for (std::int32_t i = 0; i < fine.x; ++i)
+            {
+                const std::uint64_t n = fine.idx(i, j, k);
+                if (!fine.active[n])
+                {
+                    continue;
+                }
+                double sum = 0.0;
+                for (std::int32_t kk = std::max(k/2-1, 0);
+                        kk <= std::min(k/2+1, coarse.z-1);
+                        ++kk)
+                {
+                    const double wk = weight(k, kk, coarse.z);
+                    if (wk == 0.0)
+                        continue;
+                    for (std::int32_t jj = std::max(j/2-1, 0);
+                            jj <= std::min(j/2+1, coarse.y-1);
+                            ++jj)
+                    {
+                        const double wj = weight(j, jj, coarse.y);
+                        if (wj == 0.0)
+                            continue;
+                        for (std::int32_t ii = std::max(i/2-1, 0);
+                                ii <= std::min(i/2+1, coarse.x-1);
+                                ++ii)
+                        {
+                            sum += wk * wj * weight(i, ii, coarse.x) *
+                                coarse.u[coarse.idx(ii, jj, kk)];
+                        }
+                    }
+                }
+                fine.u[n] += sum;
+            }
+        }
+    }
+}
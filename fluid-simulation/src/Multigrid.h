@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "./Eigen/Sparse"
+#include "./StaggeredGrid.h"
+
+// Geometric multigrid V-cycle on the liquid cells of the grid,
+// used as the preconditioner of the MGPCG solver
+class Multigrid
+{
+ public:
+    void build(const StaggeredGrid<Real, std::uint16_t>& grid);
+    void apply(
+            const Eigen::Ref<const Eigen::VectorXd>& r,
+            Eigen::Ref<Eigen::VectorXd> z,
+            const StaggeredGrid<Real, std::uint16_t>& grid
+        );
+
+ private:
+    struct Level
+    {
+        std::uint16_t x = 0;
+        std::uint16_t y = 0;
+        std::uint16_t z = 0;
+        std::vector<std::uint8_t> active;
+        std::vector<double> u;
+        std::vector<double> b;
+        std::vector<double> r;
+
+        inline std::uint64_t idx(
+                const std::int32_t i,
+                const std::int32_t j,
+                const std::int32_t k
+            ) const
+        {
+            return i + j * static_cast<std::uint64_t>(x)
+                + k * static_cast<std::uint64_t>(x) * y;
+        }
+        inline std::uint8_t nonSolidNeighbors(
+                const std::int32_t i,
+                const std::int32_t j,
+                const std::int32_t k
+            ) const
+        {
+            return (i > 0) + (i+1 < x) + (j > 0) + (j+1 < y)
+                + (k > 0) + (k+1 < z);
+        }
+    };
+
+    void vCycle(const std::uint64_t l);
+    void smooth(Level& level, const std::uint16_t nbIte) const;
+    void residual(Level& level) const;
+    void restriction(const Level& fine, Level& coarse) const;
+    void prolongation(const Level& coarse, Level& fine) const;
+    inline double weight(
+            const std::int32_t i,
+            const std::int32_t c,
+            const std::uint16_t nc
+        ) const;
+
+    std::vector<Level> _levels;
+
+    constexpr static std::uint16_t _coarsestSize = 4;
+    constexpr static std::uint16_t _smoothingIte = 2;
+    constexpr static std::uint16_t _coarsestIte = 40;
+    constexpr static double _omega = 2.0/3.0;
+};
@@ -1,9 +1,215 @@
 #include "Project.h"
 
+// Convergence and timings of the last pressure solve
+const SolverReport& Project::report() const
+{
+    return _report;
+}
+
+// Use the pressures of the previous step as the initial guess (x) of the
+// solver. Cells that just became liquid get the average pressure of their
+// neighbors that were liquid, or the air pressure (0) if there is none
+void Project::warmStart(Eigen::VectorXd& x) const
+{
+    const Field<Real, std::uint16_t>& P = _grid._pressure;
+    const auto& cells = _grid.activeList();
+    const std::int64_t size = cells.size();
+    #pragma omp parallel for
+    for (std::int64_t c = 0; c < size; ++c)
+    {
+        const std::uint16_t i = cells[c].i;
+        const std::uint16_t j = cells[c].j;
+        const std::uint16_t k = cells[c].k;
+        if (P.label(i, j, k) & LIQUID)
+        {
+            x.coeffRef(c) = P(i, j, k);
+            continue;
+        }
+        std::uint8_t nbNeighbors = 0;
+        double value = 0.0;
+        if (i > 0 && P.label(i-1, j, k) & LIQUID)
+        {
+            nbNeighbors++;
+            value += P(i-1, j, k);
+        }
+        if (i+1 < P.x() && P.label(i+1, j, k) & LIQUID)
+        {
+            nbNeighbors++;
+            value += P(i+1, j, k);
+        }
+        if (j > 0 && P.label(i, j-1, k) & LIQUID)
+        {
+            nbNeighbors++;
+            value += P(i, j-1, k);
+        }
+        if (j+1 < P.y() && P.label(i, j+1, k) & LIQUID)
+        {
+            nbNeighbors++;
+            value += P(i, j+1, k);
+        }
+        if (k > 0 && P.label(i, j, k-1) & LIQUID)
+        {
+            nbNeighbors++;
+            value += P(i, j, k-1);
+        }
+        if (k+1 < P.z() && P.label(i, j, k+1) & LIQUID)
+        {
+            nbNeighbors++;
+            value += P(i, j, k+1);
+        }
+        x.coeffRef(c) = nbNeighbors > 0 ? value/nbNeighbors : 0.0;
+    }
+}
+
+// Assemble the sparse Laplacian matrice (A) from the stencils
+// previously computed in the "_Adiag", "_Ax", "_Ay" and "_Az" grids.
+// The compressed storage is filled directly and in parallel, from a prefix
+// sum of the row sizes. When the liquid cells are the same as in the previous
+// frame, the sparsity pattern and storage of A are kept and only the values
+// are updated. A is symmetric, so its rows are stored as Eigen columns
+void Project::assembleMatrix(Eigen::SparseMatrix<double>& A) const
+{
+    using StorageIndex = Eigen::SparseMatrix<double>::StorageIndex;
+    const auto& cells = _grid.activeList();
+    const std::int64_t size = cells.size();
+
+    bool samePattern = A.rows() == size
+        && static_cast<std::int64_t>(_activeCells.size()) == size;
+    if (samePattern)
+    {
+        #pragma omp parallel for reduction(&&:samePattern)
+        for (std::int64_t row = 0; row < size; ++row)
+        {
+            samePattern = samePattern && _activeCells[row] == cells[row].n;
+        }
+    }
+
+    // Visit the non-zero entries of a row with f(column, value),
+    // in increasing column order as the IDs follow the grid order
+    const auto visitRow = [this, &cells](const std::int64_t row, auto&& f)
+    {
+        const std::uint64_t n = cells[row].n;
+        const std::uint16_t i = cells[row].i;
+        const std::uint16_t j = cells[row].j;
+        const std::uint16_t k = cells[row].k;
+        const auto& L = _grid._pressureID.layout();
+        const std::uint64_t prevI = L.neighbor<-1, 0, 0>(n, i, j, k);
+        const std::uint64_t prevJ = L.neighbor<0, -1, 0>(n, i, j, k);
+        const std::uint64_t nextJ = L.neighbor<0, 1, 0>(n, i, j, k);
+        const std::uint64_t prevK = L.neighbor<0, 0, -1>(n, i, j, k);
+        const std::uint64_t nextK = L.neighbor<0, 0, 1>(n, i, j, k);
+        if (k > 0 && _grid._Az(prevK) != 0.0)
+        {
+            f(_grid._pressureID(prevK)-1, _grid._Az(prevK));
+        }
+        if (j > 0 && _grid._Ay(prevJ) != 0.0)
+        {
+            f(_grid._pressureID(prevJ)-1, _grid._Ay(prevJ));
+        }
+        if (i > 0 && _grid._Ax(prevI) != 0.0)
+        {
+            f(row-1, _grid._Ax(prevI));
+        }
+        f(row, _grid.nonSolidNeighbors(i, j, k));
+        if (_grid._Ax(n) != 0.0)
+        {
+            f(row+1, _grid._Ax(n));
+        }
+        if (_grid._Ay(n) != 0.0)
+        {
+            f(_grid._pressureID(nextJ)-1, _grid._Ay(n));
+        }
+        if (_grid._Az(n) != 0.0)
+        {
+            f(_grid._pressureID(nextK)-1, _grid._Az(n));
+        }
+    };
+
+    if (!samePattern)
+    {
+        A.resize(size, size);
+        StorageIndex* outer = A.outerIndexPtr();
+        #pragma omp parallel for
+        for (std::int64_t row = 0; row < size; ++row)
+        {
+            StorageIndex count = 0;
+            visitRow(row,
+                [&count](const std::uint64_t, const double) { ++count; });
+            outer[row+1] = count;
+        }
+        std::partial_sum(outer, outer+size+1, outer);
+        A.resizeNonZeros(outer[size]);
+    }
+
+    const StorageIndex* outer = A.outerIndexPtr();
+    StorageIndex* inner = A.innerIndexPtr();
+    double* values = A.valuePtr();
+    #pragma omp parallel for
+    for (std::int64_t row = 0; row < size; ++row)
+    {
+        StorageIndex e = outer[row];
+        visitRow(row,
+            [&e, inner, values, samePattern](
+                    const std::uint64_t col,
+                    const double value
+                )
+            {
+                if (!samePattern)
+                {
+                    inner[e] = col;
+                }
+                values[e++] = value;
+            });
+    }
+}
+
+// Clear the stencils of the liquid cells of the previous solve,
+// every other cell of the stencil grids is already zero
+void Project::clearStencils()
+{
+    const std::int64_t size = _activeCells.size();
+    #pragma omp parallel for
+    for (std::int64_t c = 0; c < size; ++c)
+    {
+        const std::uint64_t n = _activeCells[c];
+        _grid._Adiag(n) = 0.0;
+        _grid._Ax(n) = 0.0;
+        _grid._Ay(n) = 0.0;
+        _grid._Az(n) = 0.0;
+        _grid._precon(n) = 0.0;
+    }
+}
+
+// Store the solved pressures (x) in the "_pressure" grid, the cells
+// that were liquid in the previous solve are cleared beforehand
+void Project::updatePressure(const Eigen::VectorXd& x)
+{
+    Field<Real, std::uint16_t>& P = _grid._pressure;
+    const std::int64_t prevSize = _activeCells.size();
+    #pragma omp parallel for
+    for (std::int64_t c = 0; c < prevSize; ++c)
+    {
+        P(_activeCells[c]) = 0.0;
+        P.label(_activeCells[c]) = EMPTY;
+    }
+
+    const auto& cells = _grid.activeList();
+    const std::int64_t size = cells.size();
+    _activeCells.resize(size);
+    #pragma omp parallel for
+    for (std::int64_t c = 0; c < size; ++c)
+    {
+        P(cells[c].n) = x(c);
+        P.label(cells[c].n) = LIQUID;
+        _activeCells[c] = cells[c].n;
+    }
+}
+
 // Ensure fluid incompressibility and borders
 // by computing its pressure and updating its velocities
 void Project3D::project()
 {
+    _report = SolverReport();
     if (_grid.activeCellsNb() > 0)
     {
         Eigen::VectorXd x(_grid.activeCellsNb());
@@ -12,164 +218,136 @@ void Project3D::project()
         // Filling A and b matrices/vector
         preparePressureSolving(_A, b);
         // Solving x vector to get pressures
-        ConjugateGradient(_A, x, b, _grid);
+        if (Config::warmStart)
+        {
+            warmStart(x);
+        }
+        ConjugateGradient(_A, x, b, _grid, _multigrid, _report);
 
-        _grid._pressure.reset();
+        updatePressure(x);
 
-        std::uint64_t id;
-        // Updates the velocities with pressures
-        for (std::uint16_t k = 0;
-            k < std::max({_grid._U.z(), _grid._V.z(), _grid._W.z()});
-            ++k)
+        // Updates the velocities with pressures. Each liquid cell updates its
+        // lower faces, and its upper faces when they are not shared with
+        // another liquid cell, so every liquid face is updated once
+        const Field<Real, std::uint16_t>& P = _grid._pressure;
+        const auto& cells = _grid.activeList();
+        const std::int64_t size = cells.size();
+        #pragma omp parallel for
+        for (std::int64_t c = 0; c < size; ++c)
         {
-            for (std::uint16_t j = 0;
-                j < std::max({_grid._U.y(), _grid._V.y(), _grid._W.y()});
-                ++j)
+            const std::uint16_t i = cells[c].i;
+            const std::uint16_t j = cells[c].j;
+            const std::uint16_t k = cells[c].k;
+            if (_grid._U.label(i, j, k) & LIQUID)
             {
-                for (std::uint16_t i = 0;
-                    i < std::max({_grid._U.x(), _grid._V.x(), _grid._W.x()});
-                    ++i)
-                {
-                    if (k < _grid._surface.z() && j < _grid._surface.y()
-                        && i < _grid._surface.x()
-                        && (id = _grid._pressureID(i, j, k)) > 0)
-                    {
-                        _grid._pressure(i, j, k) = x(id-1);
-                    }
-                    if (k < _grid._U.z() && j < _grid._U.y()
-                        && i < _grid._U.x()
-                        && _grid._U.label(i, j, k) & LIQUID)
-                    {
-                        _grid._U(i, j, k) -=
-                            Config::N*(_grid._pressure(i, j, k) -
-                                    _grid._pressure(i-1, j, k));
-                    }
-                    if (k < _grid._V.z() && j < _grid._V.y()
-                        && i < _grid._V.x()
-                        && _grid._V.label(i, j, k) & LIQUID)
-                    {
-                        _grid._V(i, j, k) -=
-                            Config::N*(_grid._pressure(i, j, k) -
-                                    _grid._pressure(i, j-1, k));
-                    }
-                    if (k < _grid._W.z() && j < _grid._W.y()
-                        && i < _grid._W.x()
-                        && _grid._W.label(i, j, k) & LIQUID)
-                    {
-                        _grid._W(i, j, k) -=
-                            Config::N*(_grid._pressure(i, j, k) -
-                                    _grid._pressure(i, j, k-1));
-                    }
-                }
+                _grid._U(i, j, k) -= Config::N*(P(i, j, k) - P(i-1, j, k));
+            }
+            if (_grid._U.label(i+1, j, k) & LIQUID
+                    && _grid._pressureID(i+1, j, k) == 0)
+            {
+                _grid._U(i+1, j, k) -= Config::N*(P(i+1, j, k) - P(i, j, k));
+            }
+            if (_grid._V.label(i, j, k) & LIQUID)
+            {
+                _grid._V(i, j, k) -= Config::N*(P(i, j, k) - P(i, j-1, k));
+            }
+            if (_grid._V.label(i, j+1, k) & LIQUID
+                    && _grid._pressureID(i, j+1, k) == 0)
+            {
+                _grid._V(i, j+1, k) -= Config::N*(P(i, j+1, k) - P(i, j, k));
+            }
+            if (_grid._W.label(i, j, k) & LIQUID)
+            {
+                _grid._W(i, j, k) -= Config::N*(P(i, j, k) - P(i, j, k-1));
+            }
+            if (_grid._W.label(i, j, k+1) & LIQUID
+                    && _grid._pressureID(i, j, k+1) == 0)
+            {
+                _grid._W(i, j, k+1) -= Config::N*(P(i, j, k+1) - P(i, j, k));
             }
         }
     }
 }
 
 // Prepare the 3D Laplacian matrice (A) with cells inside the liquid
-// and compute divergence (b) at thoses cell
+// and compute divergence (b) at thoses cell, a neighbor cell inside the
+// grid which is not liquid is air (p = 0)
 // After this we just need to find x from Ax = b
 void Project3D::preparePressureSolving(
         Eigen::SparseMatrix<double>& A,
         Eigen::VectorXd& b
     )
 {
-    A.resize(_grid.activeCellsNb(), _grid.activeCellsNb());
-    A.data().squeeze();
-    A.reserve(Eigen::VectorXi::Constant(_grid.activeCellsNb(), 7));
-    _grid._Adiag.reset();
-    _grid._Ax.reset();
-    _grid._Ay.reset();
-    _grid._Az.reset();
-    _grid._precon.reset();
+    clearStencils();
 
     const double scale = 1;
-    for (std::uint64_t n = 0; n < _grid._surface.maxIt(); ++n)
+    const auto& cells = _grid.activeList();
+    const std::int64_t size = cells.size();
+    #pragma omp parallel for
+    for (std::int64_t c = 0; c < size; ++c)
     {
-        const std::uint64_t xy =
-            static_cast<std::uint64_t>(_grid._surface.x()*_grid._surface.y());
-        const std::uint64_t m = n % xy;
-        const std::uint16_t i = m % _grid._surface.x();
-        const std::uint16_t j = m / _grid._surface.x();
-        const std::uint16_t k = n / xy;
-
-        std::uint64_t id = _grid._pressureID(i, j, k);
-        if (id > 0)
-        {
-            const std::uint64_t realID = id-1;
-            std::uint64_t neibID = 0;
-            if (i > 0 && (neibID = _grid._pressureID(i-1, j, k)) > 0)
-            {
-                A.coeffRef(realID, neibID-1) = -scale;
-                _grid._Adiag(i, j, k) += scale;
-            }
-            if (i+1 < _grid._surface.x() &&
-                    (neibID = _grid._pressureID(i+1, j, k)) > 0)
-            {
-                A.coeffRef(realID, neibID-1) = -scale;
-                _grid._Adiag(i, j, k) += scale;
-                _grid._Ax(i, j, k) = -scale;
-            }
-            else if (i+1 < _grid._surface.x() &&
-                    _grid._surface.label(i+1, j, k) & EMPTY)
-            {
-                _grid._Adiag(i, j, k) += scale;
-            }
+        const std::uint16_t i = cells[c].i;
+        const std::uint16_t j = cells[c].j;
+        const std::uint16_t k = cells[c].k;
 
-            if (j > 0 && (neibID = _grid._pressureID(i, j-1, k)) > 0)
-            {
-                A.coeffRef(realID, neibID-1) = -scale;
-                _grid._Adiag(i, j, k) += scale;
-            }
-            if (j+1 < _grid._surface.y() &&
-                    (neibID = _grid._pressureID(i, j+1, k)) > 0)
-            {
-                A.coeffRef(realID, neibID-1) = -scale;
-                _grid._Adiag(i, j, k) += scale;
-                _grid._Ay(i, j, k) = -scale;
-            }
-            else if (j+1 < _grid._surface.y() &&
-                    _grid._surface.label(i, j+1, k) & EMPTY)
-            {
-                _grid._Adiag(i, j, k) += scale;
-            }
+        std::uint64_t neibID = 0;
+        if (i > 0 && (neibID = _grid._pressureID(i-1, j, k)) > 0)
+        {
+            _grid._Adiag(i, j, k) += scale;
+        }
+        if (i+1 < _grid._surface.x() &&
+                (neibID = _grid._pressureID(i+1, j, k)) > 0)
+        {
+            _grid._Adiag(i, j, k) += scale;
+            _grid._Ax(i, j, k) = -scale;
+        }
+        else if (i+1 < _grid._surface.x())
+        {
+            _grid._Adiag(i, j, k) += scale;
+        }
 
-            if (k > 0 && (neibID = _grid._pressureID(i, j, k-1)) > 0)
-            {
-                A.coeffRef(realID, neibID-1) = -scale;
-                _grid._Adiag(i, j, k) += scale;
-            }
-            if (k+1 < _grid._surface.z() &&
-                    (neibID = _grid._pressureID(i, j, k+1)) > 0)
-            {
-                A.coeffRef(realID, neibID-1) = -scale;
-                _grid._Adiag(i, j, k) += scale;
-                _grid._Az(i, j, k) = -scale;
-            }
-            else if (k+1 < _grid._surface.z() &&
-                    _grid._surface.label(i, j, k+1) & EMPTY)
-            {
-                _grid._Adiag(i, j, k) += scale;
-            }
+        if (j > 0 && (neibID = _grid._pressureID(i, j-1, k)) > 0)
+        {
+            _grid._Adiag(i, j, k) += scale;
+        }
+        if (j+1 < _grid._surface.y() &&
+                (neibID = _grid._pressureID(i, j+1, k)) > 0)
+        {
+            _grid._Adiag(i, j, k) += scale;
+            _grid._Ay(i, j, k) = -scale;
+        }
+        else if (j+1 < _grid._surface.y())
+        {
+            _grid._Adiag(i, j, k) += scale;
+        }
 
-            std::uint8_t nonSolidNeib = 6;
-            if (i == 0)
-                nonSolidNeib--;
-            if (j == 0)
-                nonSolidNeib--;
-            if (k == 0)
-                nonSolidNeib--;
-            if (i == _grid._surface.x()-1)
-                nonSolidNeib--;
-            if (j == _grid._surface.y()-1)
-                nonSolidNeib--;
-            if (k == _grid._surface.z()-1)
-                nonSolidNeib--;
-            A.coeffRef(realID, realID) = nonSolidNeib;
-            b.coeffRef(realID) = div(i, j, k);
+        if (k > 0 && (neibID = _grid._pressureID(i, j, k-1)) > 0)
+        {
+            _grid._Adiag(i, j, k) += scale;
+        }
+        if (k+1 < _grid._surface.z() &&
+                (neibID = _grid._pressureID(i, j, k+1)) > 0)
+        {
+            _grid._Adiag(i, j, k) += scale;
+            _grid._Az(i, j, k) = -scale;
         }
+        else if (k+1 < _grid._surface.z())
+        {
+            _grid._Adiag(i, j, k) += scale;
+        }
+
+        b.coeffRef(c) = div(i, j, k);
+    }
+
+    if (Config::pressureOperator == SPARSE_MATRIX)
+    {
+        assembleMatrix(A);
+    }
+    else
+    {
+        // The CG solver applies the Laplacian straight from the stencils
+        A = Eigen::SparseMatrix<double>();
     }
-    A.makeCompressed();
 }
 
 // 3D Staggered Grid divergence with central difference
@@ -190,6 +368,7 @@ inline double Project3D::div(
 // by computing its pressure and updating its velocities
 void Project2D::project()
 {
+    _report = SolverReport();
     if (_grid.activeCellsNb() > 0)
     {
         Eigen::VectorXd x(_grid.activeCellsNb());
@@ -197,127 +376,108 @@ void Project2D::project()
 
         preparePressureSolving(_A, b);
         // Solving x vector to get pressures
-        ConjugateGradient(_A, x, b, _grid);
+        if (Config::warmStart)
+        {
+            warmStart(x);
+        }
+        ConjugateGradient(_A, x, b, _grid, _multigrid, _report);
 
-        _grid._pressure.reset();
+        updatePressure(x);
 
-        std::uint64_t id;
-        for (std::uint16_t j = 0;
-            j < std::max(_grid._U.y(), _grid._V.y());
-            ++j)
+        // Updates the velocities with pressures, as in 3D
+        const Field<Real, std::uint16_t>& P = _grid._pressure;
+        const auto& cells = _grid.activeList();
+        const std::int64_t size = cells.size();
+        #pragma omp parallel for
+        for (std::int64_t c = 0; c < size; ++c)
         {
-            for (std::uint16_t i = 0;
-                i < std::max(_grid._U.x(), _grid._V.x());
-                ++i)
+            const std::uint16_t i = cells[c].i;
+            const std::uint16_t j = cells[c].j;
+            if (_grid._U.label(i, j, 0) & LIQUID)
             {
-                if (j < _grid._surface.y() &&
-                        i < _grid._surface.x() &&
-                        (id = _grid._pressureID(i, j, 0)) > 0)
-                {
-                    _grid._pressure(i, j, 0) = x(id-1);
-                }
-                if (j < _grid._U.y() &&
-                        i < _grid._U.x() &&
-                        _grid._U.label(i, j, 0) & LIQUID)
-                {
-                    _grid._U(i, j, 0) -=
-                        Config::N*(_grid._pressure(i, j, 0) -
-                                _grid._pressure(i-1, j, 0));
-                }
-                if (j < _grid._V.y() &&
-                        i < _grid._V.x() &&
-                        _grid._V.label(i, j, 0) & LIQUID)
-                {
-                    _grid._V(i, j, 0) -=
-                        Config::N*(_grid._pressure(i, j, 0) -
-                                _grid._pressure(i, j-1, 0));
-                }
+                _grid._U(i, j, 0) -= Config::N*(P(i, j, 0) - P(i-1, j, 0));
+            }
+            if (_grid._U.label(i+1, j, 0) & LIQUID
+                    && _grid._pressureID(i+1, j, 0) == 0)
+            {
+                _grid._U(i+1, j, 0) -= Config::N*(P(i+1, j, 0) - P(i, j, 0));
+            }
+            if (_grid._V.label(i, j, 0) & LIQUID)
+            {
+                _grid._V(i, j, 0) -= Config::N*(P(i, j, 0) - P(i, j-1, 0));
+            }
+            if (_grid._V.label(i, j+1, 0) & LIQUID
+                    && _grid._pressureID(i, j+1, 0) == 0)
+            {
+                _grid._V(i, j+1, 0) -= Config::N*(P(i, j+1, 0) - P(i, j, 0));
             }
         }
     }
 }
 
 // Prepare the 2D Laplacian matrice (A) with cells inside the liquid
-// and compute divergence (b) at thoses cell
+// and compute divergence (b) at thoses cell, a neighbor cell inside the
+// grid which is not liquid is air (p = 0)
 // After this we just need to find x from Ax = b
 void Project2D::preparePressureSolving(
         Eigen::SparseMatrix<double>& A,
         Eigen::VectorXd& b
     )
 {
-    A.resize(_grid.activeCellsNb(), _grid.activeCellsNb());
-    A.data().squeeze();
-    A.reserve(Eigen::VectorXi::Constant(_grid.activeCellsNb(), 5));
-    _grid._Adiag.reset();
-    _grid._Ax.reset();
-    _grid._Ay.reset();
-    _grid._Az.reset();
-    _grid._precon.reset();
+    clearStencils();
 
     const double scale = 1;
-    for (std::uint64_t n = 0; n < _grid._surface.maxIt(); ++n)
+    const auto& cells = _grid.activeList();
+    const std::int64_t size = cells.size();
+    #pragma omp parallel for
+    for (std::int64_t c = 0; c < size; ++c)
     {
-        const std::uint64_t xy =
-            static_cast<std::uint64_t>(_grid._surface.x()*_grid._surface.y());
-        const std::uint64_t m = n % xy;
-        const std::uint16_t i = m % _grid._surface.x();
-        const std::uint16_t j = m / _grid._surface.x();
+        const std::uint16_t i = cells[c].i;
+        const std::uint16_t j = cells[c].j;
         const std::uint16_t k = 0;
 
-        std::uint64_t id = _grid._pressureID(i, j, k);
-        if (id > 0)
+        std::uint64_t neibID = 0;
+        if (i > 0 && (neibID = _grid._pressureID(i-1, j, k)) > 0)
         {
-            const std::uint64_t realID = id-1;
-            std::uint64_t neibID = 0;
-            if (i > 0 && (neibID = _grid._pressureID(i-1, j, k)) > 0)
-            {
-                A.coeffRef(realID, neibID-1) = -scale;
-                _grid._Adiag(i, j, k) += scale;
-            }
-            if (i+1 < _grid._surface.x() &&
-                    (neibID = _grid._pressureID(i+1, j, k)) > 0)
-            {
-                A.coeffRef(realID, neibID-1) = -scale;
-                _grid._Adiag(i, j, k) += scale;
-                _grid._Ax(i, j, k) = -scale;
-            }
-            else if (i+1 < _grid._surface.x() &&
-                    _grid._surface.label(i+1, j, k) & EMPTY)
-            {
-                _grid._Adiag(i, j, k) += scale;
-            }
-            if (j > 0 && (neibID = _grid._pressureID(i, j-1, k)) > 0)
-            {
-                A.coeffRef(realID, neibID-1) = -scale;
-                _grid._Adiag(i, j, k) += scale;
-            }
-            if (j+1 < _grid._surface.y() &&
-                    (neibID = _grid._pressureID(i, j+1, k)) > 0)
-            {
-                A.coeffRef(realID, neibID-1) = -scale;
-                _grid._Adiag(i, j, k) += scale;
-                _grid._Ay(i, j, k) = -scale;
-            }
-            else if (j+1 < _grid._surface.y() &&
-                    _grid._surface.label(i, j+1, k) & EMPTY)
-            {
-                _grid._Adiag(i, j, k) += scale;
-            }
-
-            std::uint8_t nonSolidNeib = 4;
-            if (i == 0)
-                nonSolidNeib--;
-            if (j == 0)
-                nonSolidNeib--;
-            if (i == _grid._surface.x()-1)
-                nonSolidNeib--;
-            if (j == _grid._surface.y()-1)
-                nonSolidNeib--;
-            A.coeffRef(realID, realID) = nonSolidNeib;
-            b.coeffRef(realID) = div(i, j, k);
+            _grid._Adiag(i, j, k) += scale;
+        }
+        if (i+1 < _grid._surface.x() &&
+                (neibID = _grid._pressureID(i+1, j, k)) > 0)
+        {
+            _grid._Adiag(i, j, k) += scale;
+            _grid._Ax(i, j, k) = -scale;
+        }
+        else if (i+1 < _grid._surface.x())
+        {
+            _grid._Adiag(i, j, k) += scale;
+        }
+        if (j > 0 && (neibID = _grid._pressureID(i, j-1, k)) > 0)
+        {
+            _grid._Adiag(i, j, k) += scale;
         }
+        if (j+1 < _grid._surface.y() &&
+                (neibID = _grid._pressureID(i, j+1, k)) > 0)
+        {
+            _grid._Adiag(i, j, k) += scale;
+            _grid._Ay(i, j, k) = -scale;
+        }
+        else if (j+1 < _grid._surface.y())
+        {
+            _grid._Adiag(i, j, k) += scale;
+        }
+
+        b.coeffRef(c) = div(i, j, k);
+    }
+
+    if (Config::pressureOperator == SPARSE_MATRIX)
+    {
+        assembleMatrix(A);
+    }
+    else
+    {
+        // The CG solver applies the Laplacian straight from the stencils
+        A = Eigen::SparseMatrix<double>();
     }
-    A.makeCompressed();
 }
 
 // 2D Staggered Grid divergence with central difference
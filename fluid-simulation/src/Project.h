@@ -1,22 +1,35 @@
 #pragma once
 
 #include <algorithm>
+#include <numeric>
+#include <vector>
 
 #include "./types.h"
 #include "./StaggeredGrid.h"
 #include "./ConjugateGradient.h"
+#include "./Multigrid.h"
 
 class Project
 {
  public:
     explicit Project(
-            StaggeredGrid<double, std::uint16_t>& grid
+            StaggeredGrid<Real, std::uint16_t>& grid
         ) : _grid(grid) {}
     virtual void project() = 0;
+    const SolverReport& report() const;
 
  protected:
+    void assembleMatrix(Eigen::SparseMatrix<double>& A) const;
+    void warmStart(Eigen::VectorXd& x) const;
+    void clearStencils();
+    void updatePressure(const Eigen::VectorXd& x);
+
     Eigen::SparseMatrix<double> _A;
-    StaggeredGrid<double, std::uint16_t>& _grid;
+    // Flat indices of the liquid cells of the previous solve
+    std::vector<std::uint64_t> _activeCells;
+    Multigrid _multigrid;
+    SolverReport _report;
+    StaggeredGrid<Real, std::uint16_t>& _grid;
 };
 
 class Project2D : public Project
@@ -327,11 +327,12 @@ void Renderer::initMaterial(Material& material) const
 // we will use mitsuba2 for clean renderings)
 void Renderer::initTexture3D(
         const std::vector<std::uint8_t>& texture,
-        const std::uint32_t textureGL
+        const std::uint32_t textureGL,
+        const std::uint32_t width,
+        const std::uint32_t height,
+        const std::uint32_t depth
     ) const
 {
-    std::uint32_t size =
-        (std::uint32_t)std::cbrt(static_cast<std::uint32_t>(texture.size()));
     glBindTexture(GL_TEXTURE_3D, textureGL);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
@@ -341,7 +342,7 @@ void Renderer::initTexture3D(
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER,
             GL_NEAREST);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_RED, size, size, size, 0,
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RED, width, height, depth, 0,
             GL_RED, GL_UNSIGNED_BYTE, texture.data());
     glGenerateMipmap(GL_TEXTURE_3D);
 }
@@ -349,10 +350,11 @@ void Renderer::initTexture3D(
 // 2D texture OpenGL initialization (with texture filtering)
 void Renderer::initTexture2D(
         const std::vector<std::uint8_t>& texture,
-        const std::uint32_t textureGL
+        const std::uint32_t textureGL,
+        const std::uint32_t width,
+        const std::uint32_t height
     ) const
 {
-    std::uint32_t size = (std::uint32_t)sqrt(texture.size()/3);
     glBindTexture(GL_TEXTURE_2D, textureGL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
@@ -361,7 +363,7 @@ void Renderer::initTexture2D(
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
             GL_LINEAR_MIPMAP_LINEAR);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, size, size, 0,
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0,
             GL_RGB, GL_UNSIGNED_BYTE, texture.data());
     glGenerateMipmap(GL_TEXTURE_2D);
 }
@@ -45,11 +45,16 @@ class Renderer
     void initMaterial(Material& material) const;
     void initTexture3D(
             const std::vector<std::uint8_t>& texture,
-            const std::uint32_t textureGL
+            const std::uint32_t textureGL,
+            const std::uint32_t width,
+            const std::uint32_t height,
+            const std::uint32_t depth
         ) const;
     void initTexture2D(
             const std::vector<std::uint8_t>& texture,
-            const std::uint32_t textureGL
+            const std::uint32_t textureGL,
+            const std::uint32_t width,
+            const std::uint32_t height
         ) const;
     void writeImg(const std::uint32_t iteration) const;
     void setLineWidth(const float width) const;
@@ -23,12 +23,36 @@ void Simulation::printStatus(const std::uint64_t it, const float dt) const
     INFO("\033[1m=== CONFIGURATION ===\033[0m");
     INFO("\033[42m[GRID]\033[49m")
     INFO("N             = " << Config::N);
+    INFO("Nx Ny Nz      = " << Config::Nx << " " << Config::Ny << " "
+            << Config::Nz);
     INFO("dim           = " << Config::dim);
     INFO("\033[42m[SOLVER]\033[49m")
     INFO("solver        = " << Config::solver);
+    INFO("operator      = " << Config::pressureOperator);
+    INFO("parallelPreconditioner = " << Config::parallelPreconditioner);
+    INFO("warmStart     = " << Config::warmStart);
+    INFO("pipelinedCG   = " << Config::pipelinedCG);
+    INFO("solverReport  = " << Config::solverReport);
     INFO("advection     = " << Config::advection);
+    INFO("backtrace     = " << Config::backtrace);
+    INFO("instructionSet = " << Config::instructionSet << " (running "
+            << interpolationInstructionSet() << ")");
+    INFO("fusedAdvection = " << Config::fusedAdvection);
+    INFO("redistancing  = " << Config::redistancing);
+    INFO("levelSetBand  = " << Config::levelSetBand);
+    INFO("narrowBandAdvection = " << Config::narrowBandAdvection);
+    INFO("redistancingDrift = " << Config::redistancingDrift);
+    INFO("redistancingInterval = " << Config::redistancingInterval);
+    INFO("extrapolationBand = " << Config::extrapolationBand);
     INFO("\033[42m[FLUID]\033[49m")
     INFO("dt            = " << Config::dt);
+    INFO("adaptiveTimeStep = " << Config::adaptiveTimeStep);
+    INFO("cfl           = " << Config::cfl);
+    INFO("dtMin dtMax   = " << Config::dtMin << " " << Config::dtMax);
+    INFO("frameTime     = " << Config::frameTime);
+    INFO("\033[42m[MEMORY]\033[49m")
+    INFO("firstTouch    = " << Config::firstTouch);
+    INFO("hugePages     = " << Config::hugePages);
     INFO("\033[42m[RENDER]\033[49m")
     INFO("exportFrames  = " << Config::exportFrames);
     INFO("renderFrames  = " << Config::renderFrames);
@@ -40,6 +64,45 @@ void Simulation::printStatus(const std::uint64_t it, const float dt) const
     {
         INFO("\033[1mITERATION " << it << "\033[0m was computed in "
                 << dt << " sec !");
+        INFO("Pressure solved in " << _fluid.solverReport().iterations
+                << " CG iterations");
+        if (Config::adaptiveTimeStep)
+        {
+            const auto& timeStep = _fluid.timeStepReport();
+            INFO("Frame simulated in " << timeStep.nbSubsteps
+                    << " substeps, last dt " << timeStep.dt
+                    << " for a max velocity of " << timeStep.maxVelocity
+                    << ", time " << timeStep.time);
+        }
+        const auto& advection = _fluid.advectionReport();
+        if (Config::fusedAdvection)
+        {
+            INFO("Velocity advected in " << 1000.0*advection.velocityTime
+                    << " ms, level set in " << 1000.0*advection.levelSetTime
+                    << " ms (" << advection.levelSetCells << " cells)");
+        }
+        else
+        {
+            INFO("Velocity advected in " << 1000.0*advection.velocityTime
+                    << " ms (U " << 1000.0*advection.uTime
+                    << ", V " << 1000.0*advection.vTime
+                    << ", W " << 1000.0*advection.wTime
+                    << "), level set in " << 1000.0*advection.levelSetTime
+                    << " ms (" << advection.levelSetCells << " cells)");
+        }
+        const auto& report = _fluid.redistancingReport();
+        if (report.redistanced)
+        {
+            INFO("Level set drift " << report.drift << ", redistanced to "
+                    << report.driftAfter);
+        }
+        else
+        {
+            INFO("Level set drift " << report.drift
+                    << ", redistancing skipped");
+        }
+        INFO("Redistanced " << report.nbRedistanced << " times, skipped "
+                << report.nbSkipped << " times");
     }
 }
 
@@ -101,7 +164,8 @@ void Simulation::renderFrame()
     if (Config::dim == 2)
     {
         _renderer.initTexture2D(_fluid.texture(),
-                _fluidRenderer.material.texture);
+                _fluidRenderer.material.texture,
+                _fluid.surface().y(), _fluid.surface().x());
         updateMeshVec();
         updateMeshGrid();
         updateMeshGridBorder();
@@ -109,7 +173,8 @@ void Simulation::renderFrame()
     else if (Config::dim == 3)
     {
         _renderer.initTexture3D(_fluid.texture(),
-                _fluidRenderer.material.texture);
+                _fluidRenderer.material.texture, _fluid.surface().x(),
+                _fluid.surface().y(), _fluid.surface().z());
     }
 
     _renderer.prePass();
@@ -148,17 +213,18 @@ void Simulation::renderFrame()
 void Simulation::updateMeshGrid()
 {
     Mesh& mesh = _fluidRenderer.meshGrid;
-    const std::uint16_t& N = Config::N;
+    const float Nx = Config::Nx;
+    const float Ny = Config::Ny;
 
     float z = 0.001f;
     std::uint64_t it = 0;
 
     mesh.vertices.clear();
     mesh.indices.clear();
-    for (float i = 0; i <= N; ++i)
+    for (float i = 0; i <= Nx; ++i)
     {
         // Arrow line drawing
-        glm::vec2 A = { (i/N)-0.5f, -1.5f };
+        glm::vec2 A = { (i/Nx)-0.5f, -1.5f };
         mesh.vertices.emplace_back(A.x);
         mesh.vertices.emplace_back(z);
         mesh.vertices.emplace_back(A.y);
@@ -168,7 +234,14 @@ void Simulation::updateMeshGrid()
         mesh.vertices.emplace_back(z);
         mesh.vertices.emplace_back(B.y);
 
-
+        mesh.indices.emplace_back(it);
+        mesh.indices.emplace_back(it+1);
+        it += 2;
+    }
+    for (float j = 0; j <= Ny; ++j)
+    {
+        glm::vec2 A = { (j/Ny)-0.5f, -1.5f };
+        glm::vec2 B = A + glm::vec2{0.0f, 1.0f};
         mesh.vertices.emplace_back(A.y);
         mesh.vertices.emplace_back(z);
         mesh.vertices.emplace_back(A.x);
@@ -179,9 +252,7 @@ void Simulation::updateMeshGrid()
 
         mesh.indices.emplace_back(it);
         mesh.indices.emplace_back(it+1);
-        mesh.indices.emplace_back(it+2);
-        mesh.indices.emplace_back(it+3);
-        it += 4;
+        it += 2;
     }
 
     _renderer.initMesh(mesh);
@@ -231,9 +302,10 @@ void Simulation::updateMeshGridBorder()
 void Simulation::updateMeshVec()
 {
     Mesh& mesh = _fluidRenderer.meshVec;
-    const std::uint16_t& N = Config::N;
-    const std::vector<double>& X = _fluid.X();
-    const std::vector<double>& Y = _fluid.Y();
+    const float Nx = Config::Nx;
+    const float Ny = Config::Ny;
+    const Field<Real, std::uint16_t>& X = _fluid.X();
+    const Field<Real, std::uint16_t>& Y = _fluid.Y();
 
     float z = 0.001f;
     std::uint64_t it = 0;
@@ -242,15 +314,15 @@ void Simulation::updateMeshVec()
     mesh.vertices.clear();
     mesh.indices.clear();
     // U vector
-    for (float j = 0; j < N; ++j)
+    for (float j = 0; j < Ny; ++j)
     {
-        for (float i = 0; i < N+1; ++i)
+        for (float i = 0; i < Nx+1; ++i)
         {
             if (_fluid.isCellActive(i, j, 0))
             {
-                float size = static_cast<float>(X[i+j*(N+1)]/reduce);
+                float size = static_cast<float>(X(i, j, 0)/reduce);
 
-                glm::vec2 A = { (i/N)-0.5f, ((j+0.5f)/N)-0.5f };
+                glm::vec2 A = { (i/Nx)-0.5f, ((j+0.5f)/Ny)-0.5f };
                 mesh.vertices.emplace_back(A.x);
                 mesh.vertices.emplace_back(z);
                 mesh.vertices.emplace_back(A.y);
@@ -264,9 +336,9 @@ void Simulation::updateMeshVec()
                 mesh.indices.emplace_back(it+1);
                 it += 2;
 
-                size = static_cast<float>(X[(i+1)+j*(N+1)]/reduce);
+                size = static_cast<float>(X(i+1, j, 0)/reduce);
 
-                A = { ((i+1)/N)-0.5f, ((j+0.5f)/N)-0.5f };
+                A = { ((i+1)/Nx)-0.5f, ((j+0.5f)/Ny)-0.5f };
                 mesh.vertices.emplace_back(A.x);
                 mesh.vertices.emplace_back(z);
                 mesh.vertices.emplace_back(A.y);
@@ -283,15 +355,15 @@ void Simulation::updateMeshVec()
         }
     }
     // V vector
-    for (float j = 0; j < N+1; ++j)
+    for (float j = 0; j < Ny+1; ++j)
     {
-        for (float i = 0; i < N; ++i)
+        for (float i = 0; i < Nx; ++i)
         {
             if (_fluid.isCellActive(i, j, 0))
             {
-                float size = static_cast<float>(Y[i+j*N]/reduce);
+                float size = static_cast<float>(Y(i, j, 0)/reduce);
 
-                glm::vec2 A = { ((i+0.5f)/N)-0.5f, (j/N)-0.5f };
+                glm::vec2 A = { ((i+0.5f)/Nx)-0.5f, (j/Ny)-0.5f };
                 mesh.vertices.emplace_back(A.x);
                 mesh.vertices.emplace_back(z);
                 mesh.vertices.emplace_back(A.y);
@@ -305,9 +377,9 @@ void Simulation::updateMeshVec()
                 mesh.indices.emplace_back(it+1);
                 it += 2;
 
-                size = static_cast<float>(Y[i+(j+1)*N]/reduce);
+                size = static_cast<float>(Y(i, j+1, 0)/reduce);
 
-                A = { ((i+0.5f)/N)-0.5f, ((j+1)/N)-0.5f };
+                A = { ((i+0.5f)/Nx)-0.5f, ((j+1)/Ny)-0.5f };
                 mesh.vertices.emplace_back(A.x);
                 mesh.vertices.emplace_back(z);
                 mesh.vertices.emplace_back(A.y);
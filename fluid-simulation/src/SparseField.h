@@ -0,0 +1,496 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "./utils.h"
+#include "./config.h"
+
+// Narrow band level set stored by tiles of 8^3 cells (8^2 in 2D), in the
+// spirit of VDB: only the active tiles, near the zero crossing, own a block
+// of values. The other tiles hold the background value with the sign of the
+// side of the interface they lie in, so the memory and the kernels iterating
+// the active tiles scale with the area of the surface instead of N^3.
+// The tiles also cover the one cell halo of the grid (not along k in 2D), so
+// the (i,j,k) accessors take -1 and the size along each axis like the Field
+// ones. The flat accessors work on the index of a cell in the blocks.
+// Tiles are (de)activated serially, the values of the active tiles can be
+// written in parallel
+template<typename T, typename U>
+class SparseField
+{
+ public:
+    explicit SparseField(U Xsize, U Ysize, U Zsize, T background)
+        : _Xsize(Xsize)
+        , _Ysize(Ysize)
+        , _Zsize(Config::dim == 2 ? 1 : Zsize)
+        , _haloZ(_Zsize == 1 ? 0 : _halo)
+        , _depth(_Zsize == 1 ? 1 : _B)
+        , _tileSize(_B * _B * _depth)
+        , _background(background)
+    {
+        _tilesX = (_Xsize + 2*_halo + _B-1) >> _log2B;
+        _tilesXY = _tilesX * ((_Ysize + 2*_halo + _B-1) >> _log2B);
+        const std::uint32_t tilesZ = (_Zsize + 2*_haloZ + _depth-1) / _depth;
+        _tiles.assign(_tilesXY * tilesZ, _OUTSIDE);
+    }
+
+    // Value of the cell (i,j,k), which is the background value
+    // with the sign of the tile if the tile is not active
+    inline T operator()(
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k
+        ) const
+    {
+        const std::uint32_t x = i + _halo;
+        const std::uint32_t y = j + _halo;
+        const std::uint32_t z = k + _haloZ;
+        const std::int32_t block = _tiles[tileIdx(x, y, z)];
+        if (block < 0)
+        {
+            return block == _INSIDE ? -_background : _background;
+        }
+        return _blocks[block * _tileSize + cellIdx(x, y, z)];
+    }
+    T& operator()(const std::uint64_t n)
+    {
+        return _blocks[n];
+    }
+    const T& operator()(const std::uint64_t n) const
+    {
+        return _blocks[n];
+    }
+    // Write access to the cell (i,j,k), whose tile must be active
+    T& at(
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k
+        )
+    {
+        const std::int64_t n = slot(i, j, k);
+#ifdef DEBUG
+        if (n < 0)
+        {
+            ERROR("Write to an inactive tile of a sparse field");
+        }
+#endif
+        return _blocks[n];
+    }
+    // Value of the cell (i+di, j+dj, k+dk), knowing the index n of (i,j,k).
+    // It is read in the block of (i,j,k) when it lies in the same tile
+    template<std::int8_t di, std::int8_t dj, std::int8_t dk>
+    inline T neighbor(
+            const std::uint64_t n,
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k
+        ) const
+    {
+        const std::uint32_t x = i + _halo;
+        const std::uint32_t y = j + _halo;
+        const std::uint32_t z = k + _haloZ;
+        if ((((x + di) ^ x) | ((y + dj) ^ y) | ((z + dk) ^ z)) >> _log2B)
+        {
+            return operator()(i + di, j + dj, k + dk);
+        }
+        return _blocks[n + di + dj * _B + dk * _B * _B];
+    }
+    // Set the cell (i,j,k), activating its tile if needed
+    void set(
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k,
+            const T value
+        )
+    {
+        const std::uint32_t tile =
+            tileIdx(i + _halo, j + _halo, k + _haloZ);
+        if (_tiles[tile] < 0)
+        {
+            activate(tile);
+        }
+        at(i, j, k) = value;
+    }
+    // Index of the cell (i,j,k) in the blocks, or -1 if its tile is inactive
+    inline std::int64_t slot(
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k
+        ) const
+    {
+        const std::uint32_t x = i + _halo;
+        const std::uint32_t y = j + _halo;
+        const std::uint32_t z = k + _haloZ;
+        const std::int32_t block = _tiles[tileIdx(x, y, z)];
+        if (block < 0)
+        {
+            return -1;
+        }
+        return static_cast<std::int64_t>(block) * _tileSize
+            + cellIdx(x, y, z);
+    }
+    const U& x() const
+    {
+        return _Xsize;
+    }
+    const U& y() const
+    {
+        return _Ysize;
+    }
+    const U& z() const
+    {
+        return _Zsize;
+    }
+    const T& background() const
+    {
+        return _background;
+    }
+    // Number of cells stored in the blocks of the active tiles
+    std::uint64_t storage() const
+    {
+        return _blocks.size();
+    }
+    // Bytes used by the tile table and the blocks
+    std::uint64_t memory() const
+    {
+        return _tiles.size() * sizeof(std::int32_t)
+            + _blocks.size() * sizeof(T)
+            + _active.size() * sizeof(std::uint32_t);
+    }
+    const std::vector<std::uint32_t>& activeTiles() const
+    {
+        return _active;
+    }
+    // Number of cells of a tile
+    std::uint32_t tileSize() const
+    {
+        return _tileSize;
+    }
+    // Number of cells along the sides of a tile (but along k in 2D)
+    std::int32_t tileWidth() const
+    {
+        return _B;
+    }
+
+    // Call f(i, j, k, n) on each cell of the tile inside the grid,
+    // n being the index of the cell in the blocks
+    template<typename Function>
+    inline void forEachCell(const std::uint32_t tile, Function f) const
+    {
+        std::int32_t i0, j0, k0;
+        tileOrigin(tile, i0, j0, k0);
+        const std::uint64_t first =
+            static_cast<std::uint64_t>(_tiles[tile]) * _tileSize;
+        for (std::int32_t kk = std::max(0, -k0);
+                kk < std::min<std::int32_t>(_depth, _Zsize - k0); ++kk)
+        {
+            for (std::int32_t jj = std::max(0, -j0);
+                    jj < std::min<std::int32_t>(_B, _Ysize - j0); ++jj)
+            {
+                for (std::int32_t ii = std::max(0, -i0);
+                        ii < std::min<std::int32_t>(_B, _Xsize - i0); ++ii)
+                {
+                    f(i0 + ii, j0 + jj, k0 + kk,
+                            first + ii + jj*_B + kk*_B*_B);
+                }
+            }
+        }
+    }
+
+    // Call f(block) on the active tiles among the tile and its neighbors
+    // (faces, edges and corners), block being the index of their block
+    template<typename Function>
+    void forEachNeighborTile(const std::uint32_t tile, Function f) const
+    {
+        const std::int32_t tilesY = _tilesXY / _tilesX;
+        const std::int32_t tilesZ = _tiles.size() / _tilesXY;
+        const std::int32_t tx = tile % _tilesX;
+        const std::int32_t ty = (tile / _tilesX) % tilesY;
+        const std::int32_t tz = tile / _tilesXY;
+        for (std::int32_t z = std::max(tz-1, 0);
+                z <= std::min(tz+1, tilesZ-1); ++z)
+        {
+            for (std::int32_t y = std::max(ty-1, 0);
+                    y <= std::min(ty+1, tilesY-1); ++y)
+            {
+                for (std::int32_t x = std::max(tx-1, 0);
+                        x <= std::min<std::int32_t>(tx+1, _tilesX-1); ++x)
+                {
+                    const std::int32_t block =
+                        _tiles[x + y * _tilesX + z * _tilesXY];
+                    if (block >= 0)
+                    {
+                        f(static_cast<std::uint32_t>(block));
+                    }
+                }
+            }
+        }
+    }
+    // Index of the block of the active tile
+    std::uint32_t tileBlock(const std::uint32_t tile) const
+    {
+        return _tiles[tile];
+    }
+    // Index of the block holding the cell n
+    std::uint32_t block(const std::uint64_t n) const
+    {
+        return n / _tileSize;
+    }
+
+    // Activate the inactive neighbors (faces, edges and corners) of the
+    // active tiles, so the interface can move by up to a tile before
+    // reaching the inactive ones
+    void dilate()
+    {
+        const std::int32_t tilesX = _tilesX;
+        const std::int32_t tilesY = _tilesXY / _tilesX;
+        const std::int32_t tilesZ = _tiles.size() / _tilesXY;
+        const std::uint64_t nbActive = _active.size();
+        for (std::uint64_t t = 0; t < nbActive; ++t)
+        {
+            const std::int32_t tx = _active[t] % _tilesX;
+            const std::int32_t ty = (_active[t] / _tilesX) % tilesY;
+            const std::int32_t tz = _active[t] / _tilesXY;
+            for (std::int32_t z = std::max(tz-1, 0);
+                    z <= std::min(tz+1, tilesZ-1); ++z)
+            {
+                for (std::int32_t y = std::max(ty-1, 0);
+                        y <= std::min(ty+1, tilesY-1); ++y)
+                {
+                    for (std::int32_t x = std::max(tx-1, 0);
+                            x <= std::min(tx+1, tilesX-1); ++x)
+                    {
+                        const std::uint32_t tile =
+                            x + y * _tilesX + z * _tilesXY;
+                        if (_tiles[tile] < 0)
+                        {
+                            activate(tile);
+                        }
+                    }
+                }
+            }
+        }
+        std::sort(_active.begin(), _active.end());
+    }
+
+    // Deactivate the tiles whose cells are all at the background value
+    // and whose neighbor cells are all on the same side of the interface,
+    // so no zero crossing is lost, except the liquid tiles along the walls.
+    // The blocks of the remaining tiles are packed at the front of the
+    // storage
+    void prune()
+    {
+        const std::int64_t nbActive = _active.size();
+        std::vector<std::int32_t> state(nbActive);
+        #pragma omp parallel for
+        for (std::int64_t t = 0; t < nbActive; ++t)
+        {
+            state[t] = uniformSign(_active[t]);
+        }
+
+        std::vector<T> blocks;
+        std::vector<std::uint32_t> active;
+        for (std::int64_t t = 0; t < nbActive; ++t)
+        {
+            const std::uint32_t tile = _active[t];
+            if (state[t] < 0)
+            {
+                _tiles[tile] = state[t];
+                continue;
+            }
+            const auto first = _blocks.begin() + _tiles[tile] * _tileSize;
+            _tiles[tile] = active.size();
+            blocks.insert(blocks.end(), first, first + _tileSize);
+            active.push_back(tile);
+        }
+        _blocks = std::move(blocks);
+        _active = std::move(active);
+    }
+
+    // Write the linear extrapolation of the two border cells in the halo
+    // cells next to the faces of the grid, the edges and corners of the
+    // halo are left untouched. Only the active tiles are filled, the halo
+    // of the other ones is at the background value like their border cells
+    void fillHalo()
+    {
+        const std::int32_t X = _Xsize;
+        const std::int32_t Y = _Ysize;
+        const std::int32_t Z = _Zsize;
+        const std::int64_t nbActive = _active.size();
+        auto& F = *this;
+        #pragma omp parallel for
+        for (std::int64_t t = 0; t < nbActive; ++t)
+        {
+            std::int32_t i0, j0, k0;
+            tileOrigin(_active[t], i0, j0, k0);
+            for (std::int32_t k = k0; k < k0 + _depth; ++k)
+            {
+                for (std::int32_t j = j0; j < j0 + _B; ++j)
+                {
+                    for (std::int32_t i = i0; i < i0 + _B; ++i)
+                    {
+                        const bool inI = i >= 0 && i < X;
+                        const bool inJ = j >= 0 && j < Y;
+                        const bool inK = Z == 1 || (k >= 0 && k < Z);
+                        if (inJ && inK && (i == -1 || i == X))
+                        {
+                            const std::int32_t b = i < 0 ? 0 : X-1;
+                            const std::int32_t in = i < 0 ? 1 : X-2;
+                            F.at(i, j, k) = 2*F(b, j, k) - F(in, j, k);
+                        }
+                        else if (inI && inK && (j == -1 || j == Y))
+                        {
+                            const std::int32_t b = j < 0 ? 0 : Y-1;
+                            const std::int32_t in = j < 0 ? 1 : Y-2;
+                            F.at(i, j, k) = 2*F(i, b, k) - F(i, in, k);
+                        }
+                        else if (inI && inJ && Z > 1 && (k == -1 || k == Z))
+                        {
+                            const std::int32_t b = k < 0 ? 0 : Z-1;
+                            const std::int32_t in = k < 0 ? 1 : Z-2;
+                            F.at(i, j, k) = 2*F(i, j, b) - F(i, j, in);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    inline double gradLength(
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k
+        ) const
+    {
+        // One-sided difference toward the neighbor closest to the
+        // interface. On the walls both sides give the same difference
+        // once the halo is linearly extrapolated
+        const auto& F = *this;
+        const T c = F(i, j, k);
+        const T iPrev = F(i-1, j, k);
+        const T iNext = F(i+1, j, k);
+        const T jPrev = F(i, j-1, k);
+        const T jNext = F(i, j+1, k);
+        const double gradI =
+            std::abs(iNext) < std::abs(iPrev) ? c - iNext : iPrev - c;
+        const double gradJ =
+            std::abs(jNext) < std::abs(jPrev) ? c - jNext : jPrev - c;
+        double gradK = 0.0;
+        if (_Zsize > 1)
+        {
+            const T kPrev = F(i, j, k-1);
+            const T kNext = F(i, j, k+1);
+            gradK = std::abs(kNext) < std::abs(kPrev) ? c - kNext : kPrev - c;
+        }
+        return std::sqrt(gradI*gradI + gradJ*gradJ + gradK*gradK);
+    }
+
+ private:
+    inline std::uint32_t tileIdx(
+            const std::uint32_t x,
+            const std::uint32_t y,
+            const std::uint32_t z
+        ) const
+    {
+        return (x >> _log2B) + (y >> _log2B) * _tilesX
+            + (z >> _log2B) * _tilesXY;
+    }
+    inline std::uint32_t cellIdx(
+            const std::uint32_t x,
+            const std::uint32_t y,
+            const std::uint32_t z
+        ) const
+    {
+        return (x & _mask) + (y & _mask) * _B + (z & _mask) * _B * _B;
+    }
+    // Coordinates of the first cell of the tile, -1 on the halo
+    inline void tileOrigin(
+            const std::uint32_t tile,
+            std::int32_t& i0,
+            std::int32_t& j0,
+            std::int32_t& k0
+        ) const
+    {
+        i0 = (tile % _tilesX) * _B - _halo;
+        j0 = ((tile % _tilesXY) / _tilesX) * _B - _halo;
+        k0 = (tile / _tilesXY) * _depth - _haloZ;
+    }
+    // Give a block to the tile, filled with its uniform value
+    void activate(const std::uint32_t tile)
+    {
+        const T value = _tiles[tile] == _INSIDE ? -_background : _background;
+        _tiles[tile] = _blocks.size() / _tileSize;
+        _blocks.resize(_blocks.size() + _tileSize, value);
+        _active.push_back(tile);
+    }
+    // _INSIDE or _OUTSIDE if the active tile can be deactivated, else 0
+    std::int32_t uniformSign(const std::uint32_t tile) const
+    {
+        std::int32_t i0, j0, k0;
+        tileOrigin(tile, i0, j0, k0);
+        const auto& F = *this;
+        const bool inside = F(std::max(i0, 0), std::max(j0, 0),
+                std::max(k0, 0)) < 0.0;
+        const T value = inside ? -_background : _background;
+        bool uniform = true;
+        forEachCell(tile, [&](std::int32_t, std::int32_t, std::int32_t,
+                    const std::uint64_t n)
+        {
+            uniform &= _blocks[n] == value;
+        });
+        // The liquid tiles along the walls are kept, the mesh of the
+        // surface being closed there
+        const bool wall = i0 <= 0 || i0+_B >= _Xsize
+            || j0 <= 0 || j0+_B >= _Ysize
+            || (_Zsize > 1 && (k0 <= 0 || k0+_depth >= _Zsize));
+        if (!uniform || (inside && wall))
+        {
+            return 0;
+        }
+        // The ring of cells around the tile, which are read by
+        // the interpolations near the border of the tile
+        const std::int32_t ring = _Zsize == 1 ? 0 : 1;
+        for (std::int32_t k = std::max(k0-ring, 0);
+                k < std::min<std::int32_t>(k0+_depth+ring, _Zsize); ++k)
+        {
+            for (std::int32_t j = std::max(j0-1, 0);
+                    j < std::min<std::int32_t>(j0+_B+1, _Ysize); ++j)
+            {
+                for (std::int32_t i = std::max(i0-1, 0);
+                        i < std::min<std::int32_t>(i0+_B+1, _Xsize); ++i)
+                {
+                    if ((F(i, j, k) < 0.0) != inside)
+                    {
+                        return 0;
+                    }
+                }
+            }
+        }
+        return inside ? _INSIDE : _OUTSIDE;
+    }
+
+    constexpr static std::int32_t _halo = 1;
+    constexpr static std::int32_t _log2B = 3;
+    constexpr static std::int32_t _B = 1 << _log2B;
+    constexpr static std::int32_t _mask = _B - 1;
+    // Values of the tile table for the inactive tiles,
+    // the active ones hold the index of their block
+    constexpr static std::int32_t _OUTSIDE = -1;
+    constexpr static std::int32_t _INSIDE = -2;
+
+    U _Xsize;
+    U _Ysize;
+    U _Zsize;
+    std::int32_t _haloZ;
+    std::int32_t _depth;
+    std::int32_t _tileSize;
+    std::uint32_t _tilesX;
+    std::uint32_t _tilesXY;
+    T _background;
+    std::vector<std::int32_t> _tiles;
+    std::vector<T> _blocks;
+    std::vector<std::uint32_t> _active;
+};
@@ -7,8 +7,13 @@
 #include "./Eigen/Sparse"
 #include "./utils.h"
 #include "./config.h"
+#include "./Allocator.h"
+#include "./Layout.h"
+#include "./SparseField.h"
 
-enum CellLabel
+// Labels of the cells, stored on one byte so a whole row of labels is
+// tested or written with a few vector instructions
+enum CellLabel : std::uint8_t
 {
     EMPTY           = (1 << 0),
     LIQUID          = (1 << 1),
@@ -21,27 +26,53 @@ constexpr inline CellLabel operator|(CellLabel a, CellLabel b)
     return static_cast<CellLabel>(static_cast<int>(a) | static_cast<int>(b));
 }
 
-template<typename T, typename U>
+// Labels of the cells whose value is known during the extrapolation
+constexpr CellLabel CHECKED = LIQUID | EXTRAPOLATED;
+
+// Boundary condition used to fill the halo of a Field
+enum HaloFill
+{
+    HALO_CONSTANT,  // Copy of the border cell
+    HALO_LINEAR     // Linear extrapolation of the two border cells
+};
+
+// Grid of values, and optionally labels, stored following the Layout policy.
+// Only the fields constructed as labelled own a label per cell, the label
+// accessors must not be used on the others.
+// The grid is surrounded by a one cell halo (not along k in 2D), so the
+// (i,j,k) accessors also take -1 and the size along each axis. The halo
+// holds the boundary conditions written by fillHalo, which lets the
+// kernels read the neighbors of the border cells without branching.
+// The flat accessors (operator()(idx), label(idx) and maxIt) work on the
+// storage index, which includes the halo and the padding of the layout
+template<typename T, typename U, typename Layout = DefaultLayout>
 class Field
 {
  public:
-    explicit Field(U Xsize, U Ysize, U Zsize)
+    explicit Field(U Xsize, U Ysize, U Zsize, const bool labelled = false)
         : _Xsize(Xsize)
         , _Ysize(Ysize)
-        , _Zsize(Zsize)
+        , _Zsize(Config::dim == 2 ? 1 : Zsize)
+        , _layout(_Xsize, _Ysize, _Zsize, _halo)
     {
-        if (Config::dim == 2)
+        _maxIt = _layout.size();
+        _grid.resize(_maxIt);
+        if (labelled)
         {
-            _Zsize = 1;
+            _label.resize(_maxIt);
         }
-        _grid.resize(_Xsize*_Ysize*_Zsize);
-        _label.resize(_Xsize*_Ysize*_Zsize);
-        for (std::uint64_t it = 0; it < _Xsize*_Ysize*_Zsize; ++it)
+        // The storage is first written here, with the same static schedule
+        // as the kernels, so its pages are spread over the NUMA nodes
+        const std::int64_t size = _maxIt;
+        #pragma omp parallel for schedule(static) if (Config::firstTouch)
+        for (std::int64_t it = 0; it < size; ++it)
         {
             _grid[it] = 0;
-            _label[it] = EMPTY;
+            if (labelled)
+            {
+                _label[it] = EMPTY;
+            }
         }
-        _maxIt = _Xsize*_Ysize*_Zsize;
     }
 
     T& operator()(const std::uint64_t idx)
@@ -52,11 +83,19 @@ class Field
     {
         return _grid[idx];
     }
-    T& operator()(const U i, const U j, const U k)
+    T& operator()(
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k
+        )
     {
         return _grid[idx(i, j, k)];
     }
-    const T& operator()(const U i, const U j, const U k) const
+    const T& operator()(
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k
+        ) const
     {
         return _grid[idx(i, j, k)];
     }
@@ -76,101 +115,58 @@ class Field
     {
         return _maxIt;
     }
-    const std::vector<T>& data() const
+    const std::vector<T, FieldAllocator<T>>& data() const
     {
         return _grid;
     }
-    const CellLabel& label(const U i, const U j, const U k) const
+    const Layout& layout() const
+    {
+        return _layout;
+    }
+    const CellLabel& label(
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k
+        ) const
     {
-        return _label[idx(i, j, k)];
+        return _label[labelIdx(i, j, k)];
     }
-    CellLabel& label(const U i, const U j, const U k)
+    CellLabel& label(
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k
+        )
     {
-        return _label[idx(i, j, k)];
+        return _label[labelIdx(i, j, k)];
     }
     CellLabel& label(const std::uint64_t idx)
     {
         return _label[idx];
     }
-    bool checked(const U i, const U j, const U k) const
+    const CellLabel& label(const std::uint64_t idx) const
     {
-        return _label[idx(i, j, k)] & LIQUID
-            || _label[idx(i, j, k)] & EXTRAPOLATED;
+        return _label[idx];
     }
-    void reset()
+    bool checked(
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k
+        ) const
     {
-        std::fill(_grid.begin(), _grid.end(), 0.0);
-        for (std::uint64_t it = 0; it < _maxIt; ++it)
-        {
-            label(it) = EMPTY;
-        }
+        return _label[labelIdx(i, j, k)] & CHECKED;
     }
-    void resetPos()
+    bool checked(const std::uint64_t idx) const
     {
-        for (std::uint64_t it = 0; it < _maxIt; ++it)
-        {
-            label(it) = EMPTY;
-        }
+        return _label[idx] & CHECKED;
     }
-    void setLabels(Field<T, U>& FU, Field<T, U>& FV, Field<T, U>& FW)
+    void reset()
     {
-        FU.resetPos();
-        FV.resetPos();
-        FW.resetPos();
-        for (std::uint16_t k = 0; k < z(); ++k)
-        {
-            for (std::uint16_t j = 0; j < y(); ++j)
-            {
-                for (std::uint16_t i = 0; i < x(); ++i)
-                {
-                    if (operator()(i, j, k) < 0.0)
-                    {
-                        FU.label(i, j, k) = LIQUID;
-                        FU.label(i+1, j, k) = LIQUID;
-                        FV.label(i, j, k) = LIQUID;
-                        FV.label(i, j+1, k) = LIQUID;
-                        FW.label(i, j, k) = LIQUID;
-                        FW.label(i, j, k+1) = LIQUID;
-                    }
-                }
-            }
-        }
-        for (std::uint16_t k = 0;
-                k < std::max({FU.z(), FV.z(), FW.z()});
-                ++k)
-        {
-            for (std::uint16_t j = 0;
-                    j < std::max({FU.y(), FV.y(), FW.y()});
-                    ++j)
-            {
-                for (std::uint16_t i = 0;
-                        i < std::max({FU.x(), FV.x(), FW.x()});
-                        ++i)
-                {
-                    if (k < FU.z() && j < FU.y() && i < FU.x())
-                    {
-                        if (i == 0 || i == FU.x()-1)
-                        {
-                            FU.label(i, j, k) = SOLID;
-                        }
-                    }
-                    if (k < FV.z() && j < FV.y() && i < FV.x())
-                    {
-                        if (j == 0 || j == FV.y()-1)
-                        {
-                            FV.label(i, j, k) = SOLID;
-                        }
-                    }
-                    if (k < FW.z() && j < FW.y() && i < FW.x())
-                    {
-                        if (k == 0 || k == FW.z()-1)
-                        {
-                            FW.label(i, j, k) = SOLID;
-                        }
-                    }
-                }
-            }
-        }
+        std::fill(_grid.begin(), _grid.end(), 0);
+        std::fill(_label.begin(), _label.end(), EMPTY);
+    }
+    void resetPos()
+    {
+        std::fill(_label.begin(), _label.end(), EMPTY);
     }
     void setFromVec(const Eigen::VectorXd& v)
     {
@@ -188,76 +184,88 @@ class Field
         }
         return v;
     }
-    inline double gradLength(const U i, const U j, const U k) const
+    // Write the boundary condition in the halo cells next to the faces of
+    // the grid, the edges and corners of the halo are left untouched
+    void fillHalo(const HaloFill mode)
     {
-        double gradI = 0.0;
-        double gradJ = 0.0;
-        double gradK = 0.0;
-        if (i == 0)
-        {
-            gradI = operator()(0, j, k) - operator()(1, j, k);
-        }
-        else if (i == _Xsize-1)
+        const auto ghost = [mode](const T border, const T inner)
         {
-            gradI = operator()(_Xsize-2, j, k) - operator()(_Xsize-1, j, k);
-        }
-        else
+            return mode == HALO_LINEAR ? static_cast<T>(2*border - inner)
+                : border;
+        };
+        const std::int32_t X = _Xsize;
+        const std::int32_t Y = _Ysize;
+        const std::int32_t Z = _Zsize;
+        auto& F = *this;
+        #pragma omp parallel for
+        for (std::int32_t k = 0; k < Z; ++k)
         {
-            if (std::abs(operator()(i+1, j, k))
-                    < std::abs(operator()(i-1, j, k)))
+            for (std::int32_t j = 0; j < Y; ++j)
             {
-                gradI = operator()(i, j, k) - operator()(i+1, j, k);
+                F(-1, j, k) = ghost(F(0, j, k), F(1, j, k));
+                F(X, j, k) = ghost(F(X-1, j, k), F(X-2, j, k));
             }
-            else
+            for (std::int32_t i = 0; i < X; ++i)
             {
-                gradI = operator()(i-1, j, k) - operator()(i, j, k);
+                F(i, -1, k) = ghost(F(i, 0, k), F(i, 1, k));
+                F(i, Y, k) = ghost(F(i, Y-1, k), F(i, Y-2, k));
             }
         }
-        if (j == 0)
-        {
-            gradJ = operator()(i, 0, k) - operator()(i, 1, k);
-        }
-        else if (j == _Ysize-1)
+        if (Z > 1)
         {
-            gradJ = operator()(i, _Ysize-2, k) - operator()(i, _Ysize-1, k);
+            #pragma omp parallel for
+            for (std::int32_t j = 0; j < Y; ++j)
+            {
+                for (std::int32_t i = 0; i < X; ++i)
+                {
+                    F(i, j, -1) = ghost(F(i, j, 0), F(i, j, 1));
+                    F(i, j, Z) = ghost(F(i, j, Z-1), F(i, j, Z-2));
+                }
+            }
         }
-        else
+    }
+    // Copy the halo cells next to the faces of the grid from F, which has
+    // the same sizes. Used after a swap to keep the boundary conditions
+    void copyHalo(const Field& F)
+    {
+        const std::int32_t X = _Xsize;
+        const std::int32_t Y = _Ysize;
+        const std::int32_t Z = _Zsize;
+        auto& G = *this;
+        #pragma omp parallel for
+        for (std::int32_t k = 0; k < Z; ++k)
         {
-            if (std::abs(operator()(i, j+1, k))
-                    < std::abs(operator()(i, j-1, k)))
+            for (std::int32_t j = 0; j < Y; ++j)
             {
-                gradJ = operator()(i, j, k) - operator()(i, j+1, k);
+                G(-1, j, k) = F(-1, j, k);
+                G(X, j, k) = F(X, j, k);
             }
-            else
+            for (std::int32_t i = 0; i < X; ++i)
             {
-                gradJ = operator()(i, j-1, k) - operator()(i, j, k);
+                G(i, -1, k) = F(i, -1, k);
+                G(i, Y, k) = F(i, Y, k);
             }
         }
-        if (k == 0)
+        if (Z > 1)
         {
-            gradK = operator()(i, j, 0) - operator()(i, j, 1);
-        }
-        else if (k == _Zsize-1)
-        {
-            gradK = operator()(i, j, _Zsize-2) - operator()(i, j, _Zsize-1);
-        }
-        else
-        {
-            if (std::abs(operator()(i, j, k+1))
-                    < std::abs(operator()(i, j, k-1)))
-            {
-                gradK = operator()(i, j, k) - operator()(i, j, k+1);
-            }
-            else
+            #pragma omp parallel for
+            for (std::int32_t j = 0; j < Y; ++j)
             {
-                gradK = operator()(i, j, k-1) - operator()(i, j, k);
+                for (std::int32_t i = 0; i < X; ++i)
+                {
+                    G(i, j, -1) = F(i, j, -1);
+                    G(i, j, Z) = F(i, j, Z);
+                }
             }
         }
-        return std::sqrt(
-                  std::pow(gradI, 2)
-                + std::pow(gradJ, 2)
-                + std::pow(gradK, 2)
-        );
+    }
+    // Exchange the values with F, which has the same sizes, without
+    // copying them. Lets a kernel write its result in a second buffer and
+    // make it the current one, instead of copying the field. The labels
+    // describe the cells, not the values, so each field keeps its own
+    void swap(Field& F)
+    {
+        _grid.swap(F._grid);
     }
 
     friend std::ostream& operator<<(std::ostream& os, const Field& obj)
@@ -282,40 +290,65 @@ class Field
         return os;
     }
 
-    inline std::uint64_t idx(const U i, const U j, const U k) const
+    // Storage index of (i,j,k), which is only range checked in debug builds
+    inline std::uint64_t idx(
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k
+        ) const
     {
-        if (i > _Xsize)
+#ifdef DEBUG
+        if (i < -_halo || i > _Xsize)
         {
             std::cout << i << std::endl;
-            ERROR("i > _Xsize");
+            ERROR("i out of [-1; _Xsize]");
         }
-        if (j > _Ysize)
+        if (j < -_halo || j > _Ysize)
         {
             std::cout << j << std::endl;
-            ERROR("j > _Ysize");
+            ERROR("j out of [-1; _Ysize]");
         }
-        if (k > _Zsize)
+        if (_Zsize == 1 ? k != 0 : (k < -_halo || k > _Zsize))
         {
             std::cout << k << std::endl;
-            ERROR("k > _Zsize");
+            ERROR("k out of [-1; _Zsize]");
         }
-        return i + j * _Xsize + k * _Xsize * _Ysize;
+#endif
+        return _layout(i, j, k);
     }
 
  private:
+    inline std::uint64_t labelIdx(
+            const std::int32_t i,
+            const std::int32_t j,
+            const std::int32_t k
+        ) const
+    {
+#ifdef DEBUG
+        if (_label.empty())
+        {
+            ERROR("label of a Field without labels");
+        }
+#endif
+        return idx(i, j, k);
+    }
+
+    constexpr static std::int32_t _halo = 1;
+
     std::uint64_t _maxIt;
-    std::vector<T> _grid;
-    std::vector<CellLabel> _label;
+    std::vector<T, FieldAllocator<T>> _grid;
+    std::vector<CellLabel, FieldAllocator<CellLabel>> _label;
     U _Xsize;
     U _Ysize;
     U _Zsize;
+    Layout _layout;
 };
 
 template<typename T, typename R>
 class StaggeredGrid
 {
  public:
-    explicit StaggeredGrid(R N) : _N(N) {}
+    explicit StaggeredGrid(R Nx, R Ny, R Nz) : _Nx(Nx), _Ny(Ny), _Nz(Nz) {}
     inline std::uint64_t hash(
             const std::uint16_t i,
             const std::uint16_t j,
@@ -324,6 +357,9 @@ class StaggeredGrid
     {
         return (static_cast<std::uint64_t>(i) << 32) | (j << 16) | k;
     }
+    // Velocity components sampled at the position of the cell (b = 0) or
+    // of the U, V or W faces (b = 1, 2 or 3). The samples next to the walls
+    // read the halo of the fields, which holds a copy of the border faces
     inline const T getU(
             const R i,
             const R j,
@@ -335,38 +371,14 @@ class StaggeredGrid
         {
             case 0:
                 return 0.5*(_U(i, j, k)+_U(i+1, j, k));
-                break;
             case 1:
                 return _U(i, j, k);
-                break;
             case 2:
-                if (j == 0)
-                {
-                    return 0.5*(_U(i, j, k)+_U(i+1, j, k));
-                }
-                else if (j == _N-1)
-                {
-                    return 0.5*(_U(i, j-1, k)+_U(i+1, j-1, k));
-                }
-                else
-                {
-                    return 0.25*(_U(i, j, k)+_U(i+1, j, k)+_U(i, j-1, k)+_U(i+1, j-1, k));
-                }
-                break;
+                return 0.25*(_U(i, j, k)+_U(i+1, j, k)
+                        +_U(i, j-1, k)+_U(i+1, j-1, k));
             case 3:
-                if (k == 0)
-                {
-                    return 0.5*(_U(i, j, k)+_U(i+1, j, k));
-                }
-                else if (k == _N-1)
-                {
-                    return 0.5*(_U(i, j, k-1)+_U(i+1, j, k-1));
-                }
-                else
-                {
-                    return 0.25*(_U(i, j, k)+_U(i+1, j, k)+_U(i, j, k-1)+_U(i+1, j, k-1));
-                }
-                break;
+                return 0.25*(_U(i, j, k)+_U(i+1, j, k)
+                        +_U(i, j, k-1)+_U(i+1, j, k-1));
         }
         ERROR("b should be either 0, 1, 2 or 3");
     }
@@ -381,38 +393,14 @@ class StaggeredGrid
         {
             case 0:
                 return 0.5*(_V(i, j, k)+_V(i, j+1, k));
-                break;
             case 1:
-                if (i == 0)
-                {
-                    return 0.5*(_V(i, j, k)+_V(i, j+1, k));
-                }
-                else if (i == _N-1)
-                {
-                    return 0.5*(_V(i-1, j, k)+_V(i-1, j+1, k));
-                }
-                else
-                {
-                    return 0.25*(_V(i, j, k)+_V(i, j+1, k)+_V(i-1, j, k)+_V(i-1, j+1, k));
-                }
-                break;
+                return 0.25*(_V(i, j, k)+_V(i, j+1, k)
+                        +_V(i-1, j, k)+_V(i-1, j+1, k));
             case 2:
                 return _V(i, j, k);
-                break;
             case 3:
-                if (k == 0)
-                {
-                    return 0.5*(_V(i, j, k)+_V(i, j+1, k));
-                }
-                else if (k == _N-1)
-                {
-                    return 0.5*(_V(i, j, k-1)+_V(i, j+1, k-1));
-                }
-                else
-                {
-                    return 0.25*(_V(i, j, k)+_V(i, j+1, k)+_V(i, j, k-1)+_V(i, j+1, k-1));
-                }
-                break;
+                return 0.25*(_V(i, j, k)+_V(i, j+1, k)
+                        +_V(i, j, k-1)+_V(i, j+1, k-1));
         }
         ERROR("b should be either 0, 1, 2 or 3");
     }
@@ -427,63 +415,100 @@ class StaggeredGrid
         {
             case 0:
                 return 0.5*(_W(i, j, k)+_W(i, j, k+1));
-                break;
             case 1:
-                if (i == 0)
-                {
-                    return 0.5*(_W(i, j, k)+_W(i, j, k+1));
-                }
-                else if (i == _N-1)
-                {
-                    return 0.5*(_W(i-1, j, k)+_W(i-1, j, k+1));
-                }
-                else
-                {
-                    return 0.25*(_W(i, j, k)+_W(i, j, k+1)+_W(i-1, j, k)+_W(i-1, j, k+1));
-                }
-                break;
+                return 0.25*(_W(i, j, k)+_W(i, j, k+1)
+                        +_W(i-1, j, k)+_W(i-1, j, k+1));
             case 2:
-                if (j == 0)
-                {
-                    return 0.5*(_W(i, j, k)+_W(i, j, k+1));
-                }
-                else if (j == _N-1)
-                {
-                    return 0.5*(_W(i, j-1, k)+_W(i, j-1, k+1));
-                }
-                else
-                {
-                    return 0.25*(_W(i, j, k)+_W(i, j, k+1)+_W(i, j-1, k)+_W(i, j-1, k+1));
-                }
-                break;
+                return 0.25*(_W(i, j, k)+_W(i, j, k+1)
+                        +_W(i, j-1, k)+_W(i, j-1, k+1));
             case 3:
                 return _W(i, j, k);
-                break;
         }
         ERROR("b should be either 0, 1, 2 or 3");
     }
+    // Liquid cell of the pressure solve, with its storage index, which is
+    // the same in every cell-centered Field of the grid
+    struct ActiveCell
+    {
+        std::uint64_t n;
+        R i;
+        R j;
+        R k;
+    };
+
+    // Find the liquid cells of the level set and number them in the grid
+    // order. The liquid cells of each row are counted in parallel, an
+    // exclusive prefix sum over the rows gives the first ID of each row,
+    // then the rows are numbered in parallel. The liquid cells are also
+    // listed in the ID order, so the kernels of the pressure solve only
+    // visit them
     void tagActiveCells()
     {
-        _activeCells = 0;
-        _pressureID.reset();
-        std::uint64_t id = 0;
-        for (std::uint16_t k = 0; k < _surface.z(); ++k)
+        const std::uint64_t X = _surface.x();
+        const std::uint64_t Y = _surface.y();
+        const std::uint64_t nbRows = Y*_surface.z();
+        const auto& L = _pressureID.layout();
+        _activeRows.assign(nbRows+1, 0);
+        #pragma omp parallel for
+        for (std::uint64_t row = 0; row < nbRows; ++row)
+        {
+            const R j = row % Y;
+            const R k = row / Y;
+            std::uint64_t count = 0;
+            for (R i = 0; i < X; ++i)
+            {
+                count += _surface(i, j, k) < 0.0;
+            }
+            _activeRows[row+1] = count;
+        }
+        for (std::uint64_t row = 0; row < nbRows; ++row)
+        {
+            _activeRows[row+1] += _activeRows[row];
+        }
+        _activeCells = _activeRows[nbRows];
+        _activeList.resize(_activeCells);
+
+        #pragma omp parallel for
+        for (std::uint64_t row = 0; row < nbRows; ++row)
         {
-            for (std::uint16_t j = 0; j < _surface.y(); ++j)
+            const R j = row % Y;
+            const R k = row / Y;
+            std::uint64_t id = _activeRows[row];
+            for (R i = 0; i < X; ++i)
             {
-                for (std::uint16_t i = 0; i < _surface.x(); ++i)
+                const std::uint64_t n = L(i, j, k);
+                if (_surface(i, j, k) < 0.0)
                 {
-                    if (_surface(i, j, k) < 0.0)
-                    {
-                        _surface.label(i, j, k) = LIQUID;
-                        _pressureID(i, j, k) = ++id;
-                        _activeCells++;
-                    }
-                    else
-                    {
-                        _surface.label(i, j, k) = EMPTY;
-                    }
+                    _activeList[id] = {n, i, j, k};
+                    _pressureID(n) = ++id;
                 }
+                else
+                {
+                    _pressureID(n) = 0;
+                }
+            }
+        }
+
+        // In 2D the wavefronts of the preconditioner are the cells of
+        // constant i+j, which are bucketed with a counting sort
+        if (_surface.z() == 1)
+        {
+            _activeFronts.assign(X+Y, 0);
+            for (const ActiveCell& cell : _activeList)
+            {
+                _activeFronts[cell.i+cell.j+1]++;
+            }
+            for (std::uint64_t front = 0; front+1 < X+Y; ++front)
+            {
+                _activeFronts[front+1] += _activeFronts[front];
+            }
+            _frontOrder.resize(_activeCells);
+            std::vector<std::uint64_t> next(_activeFronts.begin(),
+                    _activeFronts.end()-1);
+            for (std::uint64_t c = 0; c < _activeCells; ++c)
+            {
+                const ActiveCell& cell = _activeList[c];
+                _frontOrder[next[cell.i+cell.j]++] = c;
             }
         }
     }
@@ -491,28 +516,152 @@ class StaggeredGrid
     {
         return _activeCells;
     }
+    // Liquid cells in the ID order (the cell of ID id is at id-1)
+    inline const std::vector<ActiveCell>& activeList() const
+    {
+        return _activeList;
+    }
+    // Offset in the active list of the first liquid cell of each row of
+    // constant (j, k), with the row index j + k*y
+    inline const std::vector<std::uint64_t>& activeRows() const
+    {
+        return _activeRows;
+    }
+    // 2D only: offset in "frontOrder" of the first liquid cell
+    // of each wavefront of constant i+j
+    inline const std::vector<std::uint64_t>& activeFronts() const
+    {
+        return _activeFronts;
+    }
+    // 2D only: positions in the active list sorted by wavefront
+    inline const std::vector<std::uint64_t>& frontOrder() const
+    {
+        return _frontOrder;
+    }
+    // Number of neighbors of the cell (i,j,k) inside the simulation domain,
+    // which is the diagonal coefficient of the pressure Laplacian
+    inline std::uint8_t nonSolidNeighbors(
+            const R i,
+            const R j,
+            const R k
+        ) const
+    {
+        std::uint8_t nonSolidNeib = 6;
+        if (i == 0)
+            nonSolidNeib--;
+        if (j == 0)
+            nonSolidNeib--;
+        if (k == 0)
+            nonSolidNeib--;
+        if (i == _surface.x()-1)
+            nonSolidNeib--;
+        if (j == _surface.y()-1)
+            nonSolidNeib--;
+        if (k == _surface.z()-1)
+            nonSolidNeib--;
+        return nonSolidNeib;
+    }
+
+    // Label the faces of _U, _V and _W from the cells of the level set,
+    // a face is liquid if one of its two cells is and solid on the walls.
+    // The sign of the level set is first gathered in a dense mask, so each
+    // cell is only looked up once in the tiles of the level set
+    void setLabels()
+    {
+        #pragma omp parallel for collapse(2)
+        for (std::int32_t k = 0; k < _liquid.z(); ++k)
+        {
+            for (std::int32_t j = 0; j < _liquid.y(); ++j)
+            {
+                for (std::int32_t i = 0; i < _liquid.x(); ++i)
+                {
+                    _liquid(i, j, k) = _surface(i, j, k) < 0.0;
+                }
+            }
+        }
+        labelFaces<0>(_U);
+        labelFaces<1>(_V);
+        labelFaces<2>(_W);
+    }
 
-    R _N;
-    Field<T, R> _substance {_N, _N, _N};
-    Field<T, R> _surface {_N, _N, _N};
-    Field<T, R> _U {static_cast<std::uint16_t>(_N+1), _N, _N};
-    Field<T, R> _V {_N, static_cast<std::uint16_t>(_N+1), _N};
-    Field<T, R> _W {_N, _N, static_cast<std::uint16_t>(_N+1)};
-    Field<T, R> _UPrev {static_cast<std::uint16_t>(_N+1), _N, _N};
-    Field<T, R> _VPrev {_N, static_cast<std::uint16_t>(_N+1), _N};
-    Field<T, R> _WPrev {_N, _N, static_cast<std::uint16_t>(_N+1)};
-    Field<T, R> _pressure {_N, _N, _N};
-    Field<T, R> _Adiag {_N, _N, _N};
-    Field<T, R> _Ax {_N, _N, _N};
-    Field<T, R> _Ay {_N, _N, _N};
-    Field<T, R> _Az {_N, _N, _N};
-    Field<T, R> _precon {_N, _N, _N};
-    Field<T, R> _q {_N, _N, _N};
-    Field<T, R> _z {_N, _N, _N};
-    Field<std::uint64_t, R> _pressureID {_N, _N, _N};
-    Field<T, R> _substancePrev {_N, _N, _N};
-    Field<T, R> _surfacePrev {_N, _N, _N};
+    R _Nx;
+    R _Ny;
+    R _Nz;
+    Field<T, R> _substance {_Nx, _Ny, _Nz};
+    // Level set, only stored near the interface. The background value is
+    // the distance past which the redistancing clamps the level set
+    SparseField<T, R> _surface {_Nx, _Ny, _Nz,
+        static_cast<T>(Config::levelSetBand)};
+    // Only the velocities and the pressure are labelled
+    Field<T, R> _U {static_cast<R>(_Nx+1), _Ny, _Nz, true};
+    Field<T, R> _V {_Nx, static_cast<R>(_Ny+1), _Nz, true};
+    Field<T, R> _W {_Nx, _Ny, static_cast<R>(_Nz+1), true};
+    Field<T, R> _UPrev {static_cast<R>(_Nx+1), _Ny, _Nz};
+    Field<T, R> _VPrev {_Nx, static_cast<R>(_Ny+1), _Nz};
+    Field<T, R> _WPrev {_Nx, _Ny, static_cast<R>(_Nz+1)};
+    Field<T, R> _pressure {_Nx, _Ny, _Nz, true};
+    Field<T, R> _Adiag {_Nx, _Ny, _Nz};
+    Field<T, R> _Ax {_Nx, _Ny, _Nz};
+    Field<T, R> _Ay {_Nx, _Ny, _Nz};
+    Field<T, R> _Az {_Nx, _Ny, _Nz};
+    Field<T, R> _precon {_Nx, _Ny, _Nz};
+    Field<T, R> _q {_Nx, _Ny, _Nz};
+    Field<T, R> _z {_Nx, _Ny, _Nz};
+    Field<std::uint32_t, R> _pressureID {_Nx, _Ny, _Nz};
+    Field<T, R> _substancePrev {_Nx, _Ny, _Nz};
+    SparseField<T, R> _surfacePrev {_Nx, _Ny, _Nz,
+        static_cast<T>(Config::levelSetBand)};
 
  private:
+    // Each face gathers the sign of its two cells along the axis, so the
+    // faces are labelled in parallel without write conflicts. The walls
+    // along j and k are whole rows, the ones along i the ends of each row,
+    // which leaves a branchless inner loop
+    template<std::uint8_t axis>
+    void labelFaces(Field<T, R>& F) const
+    {
+        const std::int32_t last =
+            (axis == 0 ? F.x() : (axis == 1 ? F.y() : F.z())) - 1;
+        const auto& L = F.layout();
+        const auto& M = _liquid.layout();
+        #pragma omp parallel for collapse(2)
+        for (std::int32_t k = 0; k < F.z(); ++k)
+        {
+            for (std::int32_t j = 0; j < F.y(); ++j)
+            {
+                const std::int32_t face = axis == 1 ? j : k;
+                if (axis != 0 && (face == 0 || face == last))
+                {
+                    for (std::int32_t i = 0; i < F.x(); ++i)
+                    {
+                        F.label(L(i, j, k)) = SOLID;
+                    }
+                    continue;
+                }
+                const std::int32_t begin = axis == 0;
+                const std::int32_t end = axis == 0 ? last : F.x();
+                for (std::int32_t i = begin; i < end; ++i)
+                {
+                    const bool liquid = _liquid(M(i, j, k))
+                        | _liquid(M(i - (axis == 0), j - (axis == 1),
+                                    k - (axis == 2)));
+                    F.label(L(i, j, k)) = liquid ? LIQUID : EMPTY;
+                }
+                if (axis == 0)
+                {
+                    F.label(L(0, j, k)) = SOLID;
+                    F.label(L(last, j, k)) = SOLID;
+                }
+            }
+        }
+    }
+
+    // Whether each cell of the level set is liquid, written by setLabels
+    Field<std::uint8_t, R> _liquid {_Nx, _Ny, _Nz};
+
     std::uint64_t _activeCells {0};
+    std::vector<ActiveCell> _activeList;
+    std::vector<std::uint64_t> _activeRows;
+    std::vector<std::uint64_t> _activeFronts;
+    std::vector<std::uint64_t> _frontOrder;
 };
@@ -1,12 +1,40 @@
 #include "config.h"
 
+#include <omp.h>
+
+#include <cmath>
+
 namespace Config
 {
     std::uint16_t N = 64;
+    std::uint16_t Nx = 64;
+    std::uint16_t Ny = 64;
+    std::uint16_t Nz = 64;
     std::uint16_t dim = 2;
     Solver solver = PCG;
+    PressureOperator pressureOperator = MATRIX_FREE;
+    bool parallelPreconditioner = true;
+    bool warmStart = false;
+    bool pipelinedCG = false;
+    bool solverReport = false;
     Advection advection = SEMI_LAGRANGIAN;
+    Backtrace backtrace = EULER;
+    bool fusedAdvection = false;
+    InstructionSet instructionSet = AVX512;
+    Redistancing redistancing = RELAXATION;
+    std::uint16_t levelSetBand = 2;
+    bool narrowBandAdvection = false;
+    double redistancingDrift = 0.0;
+    std::uint16_t redistancingInterval = 0;
+    std::uint16_t extrapolationBand = 0;
+    bool firstTouch = true;
+    bool hugePages = false;
     double dt = 0.000004;
+    bool adaptiveTimeStep = false;
+    double cfl = 1.0;
+    double dtMin = 0.0000001;
+    double dtMax = 0.00001;
+    double frameTime = 0.00001;
     bool exportFrames = false;
     bool renderFrames = true;
     std::uint16_t width = 800;
@@ -28,10 +56,54 @@ void readConfig()
         ini.parse(is);
         inipp::get_value(ini.sections["GRID"], "N",
                 Config::N);
+        // The grid is N cells along each axis unless its size is given
+        Config::Nx = Config::N;
+        Config::Ny = Config::N;
+        Config::Nz = Config::N;
+        inipp::get_value(ini.sections["GRID"], "Nx",
+                Config::Nx);
+        inipp::get_value(ini.sections["GRID"], "Ny",
+                Config::Ny);
+        inipp::get_value(ini.sections["GRID"], "Nz",
+                Config::Nz);
         inipp::get_value(ini.sections["GRID"], "dim",
                 Config::dim);
         inipp::get_value(ini.sections["FLUID"], "dt",
                 Config::dt);
+        inipp::get_value(ini.sections["FLUID"], "adaptiveTimeStep",
+                Config::adaptiveTimeStep);
+        inipp::get_value(ini.sections["FLUID"], "cfl",
+                Config::cfl);
+        inipp::get_value(ini.sections["FLUID"], "dtMin",
+                Config::dtMin);
+        inipp::get_value(ini.sections["FLUID"], "dtMax",
+                Config::dtMax);
+        inipp::get_value(ini.sections["FLUID"], "frameTime",
+                Config::frameTime);
+        inipp::get_value(ini.sections["SOLVER"], "parallelPreconditioner",
+                Config::parallelPreconditioner);
+        inipp::get_value(ini.sections["SOLVER"], "warmStart",
+                Config::warmStart);
+        inipp::get_value(ini.sections["SOLVER"], "pipelinedCG",
+                Config::pipelinedCG);
+        inipp::get_value(ini.sections["SOLVER"], "solverReport",
+                Config::solverReport);
+        inipp::get_value(ini.sections["SOLVER"], "fusedAdvection",
+                Config::fusedAdvection);
+        inipp::get_value(ini.sections["SOLVER"], "levelSetBand",
+                Config::levelSetBand);
+        inipp::get_value(ini.sections["SOLVER"], "narrowBandAdvection",
+                Config::narrowBandAdvection);
+        inipp::get_value(ini.sections["SOLVER"], "redistancingDrift",
+                Config::redistancingDrift);
+        inipp::get_value(ini.sections["SOLVER"], "redistancingInterval",
+                Config::redistancingInterval);
+        inipp::get_value(ini.sections["SOLVER"], "extrapolationBand",
+                Config::extrapolationBand);
+        inipp::get_value(ini.sections["MEMORY"], "firstTouch",
+                Config::firstTouch);
+        inipp::get_value(ini.sections["MEMORY"], "hugePages",
+                Config::hugePages);
         inipp::get_value(ini.sections["RENDER"], "exportFrames",
                 Config::exportFrames);
         inipp::get_value(ini.sections["RENDER"], "renderFrames",
@@ -47,6 +119,42 @@ void readConfig()
         {
             ERROR("dim should be either 2 or 3");
         }
+        if (Config::firstTouch && omp_get_proc_bind() == omp_proc_bind_false)
+        {
+            WARNING("firstTouch without OMP_PROC_BIND, the threads may move "
+                    "away from the memory they touched first");
+        }
+        if (Config::Nx < 2 || Config::Ny < 2
+                || (Config::dim == 3 && Config::Nz < 2))
+        {
+            ERROR("Nx, Ny and Nz should be at least 2");
+        }
+        // The band has to fit in the ring of tiles activated around the
+        // interface before each advection
+        if (Config::levelSetBand < 1 || Config::levelSetBand > 8)
+        {
+            ERROR("levelSetBand should be in [1; 8]");
+        }
+        if (Config::adaptiveTimeStep)
+        {
+            if (Config::cfl <= 0.0 || Config::frameTime <= 0.0)
+            {
+                ERROR("cfl and frameTime should be positive");
+            }
+            if (Config::dtMin <= 0.0 || Config::dtMin > Config::dtMax)
+            {
+                ERROR("dtMin should be positive and at most dtMax");
+            }
+        }
+        // The backtraces of a step read up to cfl cells away from the band
+        // of the level set, cfl being the expected displacement of a step
+        // with a fixed time step
+        if (Config::extrapolationBand > 0 && Config::extrapolationBand
+                < Config::levelSetBand + std::ceil(Config::cfl) + 1)
+        {
+            WARNING("extrapolationBand is narrower than levelSetBand "
+                    "+ cfl + 1, the backtraces may leave it");
+        }
 
         std::string temp;
 
@@ -55,12 +163,42 @@ void readConfig()
             Config::solver = CG;
         else if (temp == "PCG")
             Config::solver = PCG;
+        else if (temp == "MGPCG")
+            Config::solver = MGPCG;
+
+        inipp::get_value(ini.sections["SOLVER"], "operator", temp);
+        if (temp == "SPARSE_MATRIX")
+            Config::pressureOperator = SPARSE_MATRIX;
+        else if (temp == "MATRIX_FREE")
+            Config::pressureOperator = MATRIX_FREE;
 
         inipp::get_value(ini.sections["SOLVER"], "advection", temp);
         if (temp == "SEMI_LAGRANGIAN")
             Config::advection = SEMI_LAGRANGIAN;
         else if (temp == "MACCORMACK")
             Config::advection = MACCORMACK;
+
+        inipp::get_value(ini.sections["SOLVER"], "backtrace", temp);
+        if (temp == "EULER")
+            Config::backtrace = EULER;
+        else if (temp == "RK2")
+            Config::backtrace = RK2;
+        else if (temp == "RK3")
+            Config::backtrace = RK3;
+
+        inipp::get_value(ini.sections["SOLVER"], "instructionSet", temp);
+        if (temp == "SCALAR")
+            Config::instructionSet = SCALAR;
+        else if (temp == "AVX2")
+            Config::instructionSet = AVX2;
+        else if (temp == "AVX512")
+            Config::instructionSet = AVX512;
+
+        inipp::get_value(ini.sections["SOLVER"], "redistancing", temp);
+        if (temp == "RELAXATION")
+            Config::redistancing = RELAXATION;
+        else if (temp == "FAST_SWEEPING")
+            Config::redistancing = FAST_SWEEPING;
     }
 }
 
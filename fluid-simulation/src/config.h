@@ -10,10 +10,34 @@
 namespace Config
 {
     extern std::uint16_t N;
+    extern std::uint16_t Nx;
+    extern std::uint16_t Ny;
+    extern std::uint16_t Nz;
     extern std::uint16_t dim;
     extern double dt;
+    extern bool adaptiveTimeStep;
+    extern double cfl;
+    extern double dtMin;
+    extern double dtMax;
+    extern double frameTime;
     extern Solver solver;
+    extern PressureOperator pressureOperator;
+    extern bool parallelPreconditioner;
+    extern bool warmStart;
+    extern bool pipelinedCG;
+    extern bool solverReport;
     extern Advection advection;
+    extern Backtrace backtrace;
+    extern bool fusedAdvection;
+    extern InstructionSet instructionSet;
+    extern Redistancing redistancing;
+    extern std::uint16_t levelSetBand;
+    extern bool narrowBandAdvection;
+    extern double redistancingDrift;
+    extern std::uint16_t redistancingInterval;
+    extern std::uint16_t extrapolationBand;
+    extern bool firstTouch;
+    extern bool hugePages;
     extern bool exportFrames;
     extern bool renderFrames;
     extern std::uint16_t width;
@@ -4,6 +4,14 @@
 
 #include "./Shader.h"
 
+// Storage type of the simulation fields, the pressure solve itself
+// (CG vectors and reductions) always stays in double
+#ifdef SINGLE_PRECISION
+using Real = float;
+#else
+using Real = double;
+#endif
+
 enum RenderMode
 {
     TRIANGLES,
@@ -13,7 +21,14 @@ enum RenderMode
 enum Solver
 {
     CG,
-    PCG
+    PCG,
+    MGPCG
+};
+
+enum PressureOperator
+{
+    SPARSE_MATRIX,
+    MATRIX_FREE
 };
 
 enum Advection
@@ -22,6 +37,27 @@ enum Advection
     MACCORMACK
 };
 
+enum Backtrace
+{
+    EULER,
+    RK2,
+    RK3
+};
+
+enum Redistancing
+{
+    RELAXATION,
+    FAST_SWEEPING
+};
+
+// Ordered from the narrowest to the widest
+enum InstructionSet
+{
+    SCALAR,
+    AVX2,
+    AVX512
+};
+
 struct Transform
 {
     glm::vec3 position;